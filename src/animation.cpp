@@ -27,6 +27,7 @@
 #include <cassert>
 
 #include "animation.h"
+#include "images.h"
 
 Animation::Animation()
 	: cycles(0),
@@ -80,6 +81,33 @@ bool Animation::needsRedraw(time_t now) const
 	return false;
 }
 
+time_t Animation::nextFrameChange(time_t now) const
+{
+	if (!cycles)
+		return ANIM_NO_FRAME_CHANGE;
+
+	time_t pos = now - offset;
+	size_t frame = (size_t)((pos % cycleTime) / frameTime);
+	if (frame != frameShowing)
+		return now;
+	return now + frameTime - pos % frameTime;
+}
+
+bool Animation::isStatic() const
+{
+	return cycles == 0;
+}
+
+bool Animation::isOpaque() const
+{
+	if (frames.empty())
+		return false;
+	for (const auto& frame : frames)
+		if (!frame || frame->opacity() != OPACITY_OPAQUE)
+			return false;
+	return true;
+}
+
 Image* Animation::frame(time_t now)
 {
 	if (frames.size() == 0)
@@ -28,6 +28,7 @@
 #ifndef ANIMATED_H
 #define ANIMATED_H
 
+#include <limits>
 #include <memory>
 #include <time.h>
 #include <vector>
@@ -36,6 +37,10 @@ class Image;
 
 #define ANIM_INFINITE_CYCLES -1
 
+//! Returned by Animation::nextFrameChange() for Animations that will not
+//! change frames on their own.
+#define ANIM_NO_FRAME_CHANGE (std::numeric_limits<time_t>::max())
+
 /**
  * An Animation is a sequence of bitmap images (called frames) used to creates
  * the illusion of motion. Frames are cycled over with an even amount of time
@@ -93,6 +98,28 @@ public:
 	 */
 	bool needsRedraw(time_t now) const;
 
+	/**
+	 * When will this Animation next show a frame different from the one
+	 * returned by the last call to frame()? Returns now if that has
+	 * already happened, or ANIM_NO_FRAME_CHANGE if it never will.
+	 *
+	 * @now current time in milliseconds
+	 */
+	time_t nextFrameChange(time_t now) const;
+
+	/**
+	 * Will this Animation keep showing the same frame? True for
+	 * single-frame Animations and for those that have finished their
+	 * cycles.
+	 */
+	bool isStatic() const;
+
+	/**
+	 * Does every frame of this Animation completely hide what is drawn
+	 * beneath it?
+	 */
+	bool isOpaque() const;
+
 	/**
 	 * Returns the image that should be displayed at this time.
 	 *
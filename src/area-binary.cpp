@@ -0,0 +1,475 @@
+/**********************************
+** Tsunagari Tile Engine         **
+** area-binary.cpp               **
+** Copyright 2015 PariahSoft LLC **
+**********************************/
+
+// **********
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+// **********
+
+
+#include <fstream>
+#include <string.h>
+
+#include "area-binary.h"
+#include "area-tmx.h"
+#include "formatter.h"
+#include "log.h"
+#include "resources.h"
+#include "validation-cache.h"
+
+#define ASSERT(x)  if (!(x)) { return false; }
+
+/* Layout of a compiled area, all in the byte order of the machine that
+   compiled it:
+
+     header    magic, version, byte order mark, 64-bit hash of the TMX
+               and TSX files compiled from
+     map       width, height, tile width, tile height, name, intro music,
+               main music, property bits, color overlay
+     tilesets  count, then for each: image, first gid, width, height, and
+               its explicitly declared tile types
+     layers    count, then for each: depth, and its flat array of gids
+     objects   count, then for each: layer, rectangle, flags, scripts, and
+               for each ExitDirection its exit and layermod, if any
+
+   Integers are 32 bits and depths are doubles. Strings and arrays are a
+   count followed by their elements. A layer's gids are stored exactly as
+   they are held in memory so they can be read with a single copy.
+*/
+
+static const char magic[4] = {'T', 'S', 'A', 'R'};
+static const uint32_t byteOrderMark = 0x01020304;
+
+// Map property bits.
+#define AREA_MUSIC_INTRO_SET 0x1
+#define AREA_MUSIC_LOOP_SET  0x2
+#define AREA_LOOP_X          0x4
+#define AREA_LOOP_Y          0x8
+
+// Object bits, one set per ExitDirection.
+#define OBJECT_EXIT          0x1
+#define OBJECT_EXIT_WWIDE    0x2
+#define OBJECT_EXIT_HWIDE    0x4
+#define OBJECT_LAYERMOD      0x8
+
+
+//! Appends values to a compiled area.
+class BinaryWriter
+{
+public:
+	void raw(const void* data, size_t size);
+	void u32(uint32_t v);
+	void i32(int v);
+	void f64(double v);
+	void str(const std::string& s);
+
+	std::string buf;
+};
+
+void BinaryWriter::raw(const void* data, size_t size)
+{
+	buf.append((const char*)data, size);
+}
+
+void BinaryWriter::u32(uint32_t v)
+{
+	raw(&v, sizeof(v));
+}
+
+void BinaryWriter::i32(int v)
+{
+	int32_t i = (int32_t)v;
+	raw(&i, sizeof(i));
+}
+
+void BinaryWriter::f64(double v)
+{
+	raw(&v, sizeof(v));
+}
+
+void BinaryWriter::str(const std::string& s)
+{
+	u32((uint32_t)s.size());
+	raw(s.data(), s.size());
+}
+
+
+//! Reads values from a compiled area. Every read fails rather than run past
+//! the end of the data.
+class BinaryReader
+{
+public:
+	BinaryReader(const char* data, size_t size);
+
+	bool raw(void* data, size_t size);
+	bool u32(uint32_t* v);
+	bool i32(int* v);
+	bool f64(double* v);
+	bool str(std::string* s);
+
+	//! Read the length of an array whose elements take at least elemSize
+	//! bytes each. Fails if they can't all be present.
+	bool count(uint32_t* n, size_t elemSize);
+
+private:
+	const char* pos;
+	const char* end;
+};
+
+BinaryReader::BinaryReader(const char* data, size_t size)
+	: pos(data), end(data + size)
+{
+}
+
+bool BinaryReader::raw(void* data, size_t size)
+{
+	ASSERT((size_t)(end - pos) >= size);
+	memcpy(data, pos, size);
+	pos += size;
+	return true;
+}
+
+bool BinaryReader::u32(uint32_t* v)
+{
+	return raw(v, sizeof(*v));
+}
+
+bool BinaryReader::i32(int* v)
+{
+	int32_t i;
+	ASSERT(raw(&i, sizeof(i)));
+	*v = (int)i;
+	return true;
+}
+
+bool BinaryReader::f64(double* v)
+{
+	return raw(v, sizeof(*v));
+}
+
+bool BinaryReader::str(std::string* s)
+{
+	uint32_t len;
+	ASSERT(count(&len, 1));
+	s->assign(pos, len);
+	pos += len;
+	return true;
+}
+
+bool BinaryReader::count(uint32_t* n, size_t elemSize)
+{
+	ASSERT(u32(n));
+	return (size_t)(end - pos) / elemSize >= *n;
+}
+
+
+std::string writeAreaBinary(const AreaDesc& desc, uint64_t sourceHash)
+{
+	BinaryWriter w;
+
+	w.raw(magic, sizeof(magic));
+	w.u32(AREA_BINARY_VERSION);
+	w.u32(byteOrderMark);
+	w.raw(&sourceHash, sizeof(sourceHash));
+
+	w.i32(desc.dim.x);
+	w.i32(desc.dim.y);
+	w.i32(desc.tileDim.x);
+	w.i32(desc.tileDim.y);
+	w.str(desc.name);
+	w.str(desc.musicIntro);
+	w.str(desc.musicLoop);
+	w.u32((desc.musicIntroSet ? AREA_MUSIC_INTRO_SET : 0) |
+	      (desc.musicLoopSet ? AREA_MUSIC_LOOP_SET : 0) |
+	      (desc.loopX ? AREA_LOOP_X : 0) |
+	      (desc.loopY ? AREA_LOOP_Y : 0));
+	w.u32(desc.colorOverlayARGB);
+
+	w.u32((uint32_t)desc.tileSets.size());
+	for (auto& set : desc.tileSets) {
+		w.str(set.imgSource);
+		w.str(set.tsxSource);
+		w.i32(set.firstGid);
+		w.i32(set.width);
+		w.i32(set.height);
+		w.u32((uint32_t)set.types.size());
+		for (auto& type : set.types) {
+			w.i32(type.id);
+			w.u32(type.flags);
+			w.str(type.enterScript);
+			w.str(type.leaveScript);
+			w.str(type.useScript);
+			w.u32((uint32_t)type.frames.size());
+			for (int frame : type.frames)
+				w.i32(frame);
+			w.i32(type.frameLen);
+			w.i32(type.cycles);
+		}
+	}
+
+	w.u32((uint32_t)desc.layers.size());
+	for (auto& layer : desc.layers) {
+		w.f64(layer.depth);
+		w.u32((uint32_t)layer.gids.size());
+		w.raw(layer.gids.data(), layer.gids.size() * sizeof(uint32_t));
+	}
+
+	w.u32((uint32_t)desc.objects.size());
+	for (auto& obj : desc.objects) {
+		w.i32(obj.z);
+		w.i32(obj.x);
+		w.i32(obj.y);
+		w.i32(obj.w);
+		w.i32(obj.h);
+		w.u32(obj.flags);
+		w.str(obj.enterScript);
+		w.str(obj.leaveScript);
+		w.str(obj.useScript);
+		for (size_t i = 0; i < EXITS_LENGTH; i++) {
+			w.u32((obj.hasExit[i] ? OBJECT_EXIT : 0) |
+			      (obj.wwide[i] ? OBJECT_EXIT_WWIDE : 0) |
+			      (obj.hwide[i] ? OBJECT_EXIT_HWIDE : 0) |
+			      (obj.hasLayermod[i] ? OBJECT_LAYERMOD : 0));
+			if (obj.hasExit[i]) {
+				const Exit& exit = obj.exits[i];
+				w.str(exit.area);
+				w.i32(exit.coords.x);
+				w.i32(exit.coords.y);
+				w.f64(exit.coords.z);
+			}
+			if (obj.hasLayermod[i])
+				w.f64(obj.layermods[i]);
+		}
+	}
+
+	return w.buf;
+}
+
+static bool readTileSets(BinaryReader& r, AreaDesc* desc)
+{
+	uint32_t setCnt, typeCnt, frameCnt;
+
+	ASSERT(r.count(&setCnt, 1));
+	desc->tileSets.resize(setCnt);
+	for (auto& set : desc->tileSets) {
+		ASSERT(r.str(&set.imgSource));
+		ASSERT(r.str(&set.tsxSource));
+		ASSERT(r.i32(&set.firstGid));
+		ASSERT(r.i32(&set.width));
+		ASSERT(r.i32(&set.height));
+		ASSERT(r.count(&typeCnt, 1));
+		set.types.resize(typeCnt);
+		for (auto& type : set.types) {
+			ASSERT(r.i32(&type.id));
+			ASSERT(r.u32(&type.flags));
+			ASSERT(r.str(&type.enterScript));
+			ASSERT(r.str(&type.leaveScript));
+			ASSERT(r.str(&type.useScript));
+			ASSERT(r.count(&frameCnt, sizeof(int32_t)));
+			type.frames.resize(frameCnt);
+			for (int& frame : type.frames)
+				ASSERT(r.i32(&frame));
+			ASSERT(r.i32(&type.frameLen));
+			ASSERT(r.i32(&type.cycles));
+		}
+	}
+	return true;
+}
+
+static bool readLayers(BinaryReader& r, AreaDesc* desc)
+{
+	uint32_t layerCnt, gidCnt;
+
+	ASSERT(r.count(&layerCnt, 1));
+	desc->layers.resize(layerCnt);
+	for (auto& layer : desc->layers) {
+		ASSERT(r.f64(&layer.depth));
+		ASSERT(r.count(&gidCnt, sizeof(uint32_t)));
+		layer.gids.resize(gidCnt);
+		ASSERT(r.raw(layer.gids.data(), gidCnt * sizeof(uint32_t)));
+	}
+	return true;
+}
+
+static bool readObjects(BinaryReader& r, AreaDesc* desc)
+{
+	uint32_t objCnt, bits;
+
+	ASSERT(r.count(&objCnt, 1));
+	desc->objects.resize(objCnt);
+	for (auto& obj : desc->objects) {
+		ASSERT(r.i32(&obj.z));
+		ASSERT(r.i32(&obj.x));
+		ASSERT(r.i32(&obj.y));
+		ASSERT(r.i32(&obj.w));
+		ASSERT(r.i32(&obj.h));
+		ASSERT(r.u32(&obj.flags));
+		ASSERT(r.str(&obj.enterScript));
+		ASSERT(r.str(&obj.leaveScript));
+		ASSERT(r.str(&obj.useScript));
+		for (size_t i = 0; i < EXITS_LENGTH; i++) {
+			ASSERT(r.u32(&bits));
+			obj.hasExit[i] = (bits & OBJECT_EXIT) != 0;
+			obj.wwide[i] = (bits & OBJECT_EXIT_WWIDE) != 0;
+			obj.hwide[i] = (bits & OBJECT_EXIT_HWIDE) != 0;
+			obj.hasLayermod[i] = (bits & OBJECT_LAYERMOD) != 0;
+			if (obj.hasExit[i]) {
+				Exit& exit = obj.exits[i];
+				ASSERT(r.str(&exit.area));
+				ASSERT(r.i32(&exit.coords.x));
+				ASSERT(r.i32(&exit.coords.y));
+				ASSERT(r.f64(&exit.coords.z));
+			}
+			if (obj.hasLayermod[i])
+				ASSERT(r.f64(&obj.layermods[i]));
+		}
+	}
+	return true;
+}
+
+bool readAreaBinary(const std::string& path, const void* data, size_t size,
+                    AreaDesc* desc, uint64_t* sourceHash)
+{
+	BinaryReader r((const char*)data, size);
+
+	char fileMagic[sizeof(magic)];
+	uint32_t version, bom;
+
+	if (!r.raw(fileMagic, sizeof(fileMagic)) ||
+	    memcmp(fileMagic, magic, sizeof(magic)) != 0) {
+		Log::err(path, "not a compiled area");
+		return false;
+	}
+	if (!r.u32(&version) || version != AREA_BINARY_VERSION ||
+	    !r.u32(&bom) || bom != byteOrderMark) {
+		Log::info(path, "compiled for another version of the engine "
+			"or another machine, ignoring");
+		return false;
+	}
+
+	uint32_t bits;
+
+	if (!r.raw(sourceHash, sizeof(*sourceHash)) ||
+	    !r.i32(&desc->dim.x) || !r.i32(&desc->dim.y) ||
+	    !r.i32(&desc->tileDim.x) || !r.i32(&desc->tileDim.y) ||
+	    !r.str(&desc->name) ||
+	    !r.str(&desc->musicIntro) || !r.str(&desc->musicLoop) ||
+	    !r.u32(&bits) || !r.u32(&desc->colorOverlayARGB) ||
+	    !readTileSets(r, desc) || !readLayers(r, desc) ||
+	    !readObjects(r, desc)) {
+		Log::err(path, "compiled area is truncated");
+		return false;
+	}
+
+	desc->musicIntroSet = (bits & AREA_MUSIC_INTRO_SET) != 0;
+	desc->musicLoopSet = (bits & AREA_MUSIC_LOOP_SET) != 0;
+	desc->loopX = (bits & AREA_LOOP_X) != 0;
+	desc->loopY = (bits & AREA_LOOP_Y) != 0;
+
+	return true;
+}
+
+bool loadAreaBinary(const std::string& descriptor, AreaDesc* desc)
+{
+	std::string path = descriptor + AREA_BINARY_EXT;
+
+	Resources& resources = Resources::instance();
+	if (!resources.exists(path))
+		return false;
+
+	std::unique_ptr<Resource> r = resources.load(path);
+	ASSERT(r);
+	uint64_t compiledFrom;
+	if (!readAreaBinary(path, r->data(), r->size(), desc, &compiledFrom)) {
+		Log::info(path, "reading the TMX file instead");
+		return false;
+	}
+
+	// Worlds may ship compiled areas without their sources.
+	if (!resources.exists(descriptor)) {
+		Log::info(descriptor, "using compiled area");
+		return true;
+	}
+
+	uint64_t current;
+	if (!areaSourceHash(descriptor, *desc, &current) ||
+	    current != compiledFrom) {
+		Log::info(path, "older than the TMX or TSX files it was "
+			"compiled from, reading the TMX file instead");
+		return false;
+	}
+
+	Log::info(descriptor, "using compiled area");
+	return true;
+}
+
+bool areaSourceHash(const std::string& descriptor, const AreaDesc& desc,
+                    uint64_t* hash)
+{
+	Resources& resources = Resources::instance();
+
+	std::unique_ptr<Resource> tmx = resources.load(descriptor);
+	ASSERT(tmx);
+	uint64_t h = ValidationCache::hash(tmx->data(), tmx->size(),
+		AREA_BINARY_VERSION);
+
+	for (auto& set : desc.tileSets) {
+		if (set.tsxSource.empty())
+			continue;
+		std::unique_ptr<Resource> tsx = resources.load(set.tsxSource);
+		ASSERT(tsx);
+		h = ValidationCache::hash(tsx->data(), tsx->size(), h);
+	}
+
+	*hash = h;
+	return true;
+}
+
+bool compileArea(const std::string& descriptor)
+{
+	AreaDesc desc;
+	if (!parseTMX(descriptor, &desc)) {
+		Log::err(descriptor, "could not compile area");
+		return false;
+	}
+
+	uint64_t sourceHash;
+	if (!areaSourceHash(descriptor, desc, &sourceHash)) {
+		Log::err(descriptor, "could not compile area");
+		return false;
+	}
+
+	std::string blob = writeAreaBinary(desc, sourceHash);
+	std::string path = descriptor + AREA_BINARY_EXT;
+
+	std::ofstream out(path.c_str(), std::ios::out | std::ios::binary);
+	out.write(blob.data(), (std::streamsize)blob.size());
+	out.close();
+	if (!out) {
+		Log::err(path, "could not write compiled area");
+		return false;
+	}
+
+	Log::info(descriptor, Formatter("compiled into % (% bytes)") %
+		path % blob.size());
+	return true;
+}
+
@@ -0,0 +1,68 @@
+/**********************************
+** Tsunagari Tile Engine         **
+** area-binary.h                 **
+** Copyright 2015 PariahSoft LLC **
+**********************************/
+
+// **********
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+// **********
+
+
+#ifndef AREA_BINARY_H
+#define AREA_BINARY_H
+
+#include <stdint.h>
+
+#include <string>
+
+#include "area-desc.h"
+
+//! Appended to an Area's descriptor to find its compiled form.
+#define AREA_BINARY_EXT ".bin"
+
+//! Changed whenever the layout of a compiled area changes. Compiled areas
+//! made for any other version are ignored.
+#define AREA_BINARY_VERSION 3
+
+//! Serialize an Area description into a compiled area. The source hash is
+//! that of the files it was compiled from, see areaSourceHash().
+std::string writeAreaBinary(const AreaDesc& desc, uint64_t sourceHash);
+
+//! Deserialize a compiled area. Returns false if the data is not a compiled
+//! area of this version and byte order.
+bool readAreaBinary(const std::string& path, const void* data, size_t size,
+                    AreaDesc* desc, uint64_t* sourceHash);
+
+//! Hash of the bytes of an Area's TMX file and the TSX files it uses.
+//! Returns false if any of them can't be read.
+bool areaSourceHash(const std::string& descriptor, const AreaDesc& desc,
+                    uint64_t* hash);
+
+//! Read the compiled form of an Area from the world's data. Returns false if
+//! there is none, it can't be used, or it is older than the TMX or TSX files
+//! it was compiled from, in which case the TMX file should be read instead.
+bool loadAreaBinary(const std::string& descriptor, AreaDesc* desc);
+
+//! Compile an Area's TMX file from the world's data into the current
+//! directory. See --compile-area.
+bool compileArea(const std::string& descriptor);
+
+#endif
+
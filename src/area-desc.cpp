@@ -0,0 +1,63 @@
+/**********************************
+** Tsunagari Tile Engine         **
+** area-desc.cpp                 **
+** Copyright 2015 PariahSoft LLC **
+**********************************/
+
+// **********
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+// **********
+
+
+#include "animation.h"
+#include "area-desc.h"
+
+AreaDesc::AreaDesc()
+	: dim(0, 0), tileDim(0, 0),
+	  musicIntroSet(false), musicLoopSet(false),
+	  loopX(false), loopY(false),
+	  colorOverlayARGB(0)
+{
+}
+
+AreaDesc::TileTypeDesc::TileTypeDesc()
+	: id(0), flags(0x0), frameLen(-1), cycles(ANIM_INFINITE_CYCLES)
+{
+}
+
+AreaDesc::TileSetDesc::TileSetDesc()
+	: firstGid(0), width(0), height(0)
+{
+}
+
+AreaDesc::LayerDesc::LayerDesc()
+	: depth(0.0)
+{
+}
+
+AreaDesc::ObjectDesc::ObjectDesc()
+	: z(0), x(0), y(0), w(0), h(0), flags(0x0)
+{
+	for (size_t i = 0; i < EXITS_LENGTH; i++) {
+		hasExit[i] = wwide[i] = hwide[i] = false;
+		hasLayermod[i] = false;
+		layermods[i] = 0.0;
+	}
+}
+
@@ -0,0 +1,127 @@
+/**********************************
+** Tsunagari Tile Engine         **
+** area-desc.h                   **
+** Copyright 2015 PariahSoft LLC **
+**********************************/
+
+// **********
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+// **********
+
+
+#ifndef AREA_DESC_H
+#define AREA_DESC_H
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "tile.h"
+#include "vec.h"
+
+//! Everything read from an Area's map file, before any Tiles are allocated or
+//! any images or scripts are looked up.
+/*!
+	An AreaDesc can come from a TMX file, see parseTMX(), or from a
+	compiled area, see readAreaBinary(). Area::build() turns either into a
+	working Area.
+*/
+struct AreaDesc
+{
+	AreaDesc();
+
+	//! A TileType declared explicitly by a tileset.
+	struct TileTypeDesc {
+		TileTypeDesc();
+
+		//! Index of the tile within its tileset image.
+		int id;
+		unsigned flags;
+		std::string enterScript, leaveScript, useScript;
+
+		//! Animation frames, as indices within the tileset image.
+		//! Empty if the type is not animated.
+		std::vector<int> frames;
+		int frameLen;
+		int cycles;
+	};
+
+	struct TileSetDesc {
+		TileSetDesc();
+
+		std::string imgSource;
+
+		//! Path of the TSX file the tileset was read from, if any.
+		std::string tsxSource;
+
+		int firstGid;
+
+		//! Size of the image in Tiles.
+		int width, height;
+
+		std::vector<TileTypeDesc> types;
+	};
+
+	struct LayerDesc {
+		LayerDesc();
+
+		double depth;
+
+		//! Global tile ids, row by row. Zero means there is no Tile.
+		//! Empty for layers only created by an <objectgroup>.
+		std::vector<uint32_t> gids;
+	};
+
+	//! Properties applied to a rectangle of Tiles on one layer.
+	struct ObjectDesc {
+		ObjectDesc();
+
+		//! Layer index, and position and size in Tiles.
+		int z, x, y, w, h;
+
+		unsigned flags;
+		std::string enterScript, leaveScript, useScript;
+
+		//! Indexed by ExitDirection. A wide exit's destination moves
+		//! along with the Tile within the rectangle.
+		bool hasExit[EXITS_LENGTH];
+		Exit exits[EXITS_LENGTH];
+		bool wwide[EXITS_LENGTH], hwide[EXITS_LENGTH];
+
+		bool hasLayermod[EXITS_LENGTH];
+		double layermods[EXITS_LENGTH];
+	};
+
+	ivec2 dim;
+	ivec2 tileDim;
+
+	std::string name;
+	std::string musicIntro, musicLoop;
+	bool musicIntroSet, musicLoopSet;
+	bool loopX, loopY;
+	uint32_t colorOverlayARGB;
+
+	std::vector<TileSetDesc> tileSets;
+	std::vector<LayerDesc> layers;
+	std::vector<ObjectDesc> objects;
+};
+
+#endif
+
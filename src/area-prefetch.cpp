@@ -0,0 +1,158 @@
+/**********************************
+** Tsunagari Tile Engine         **
+** area-prefetch.cpp             **
+** Copyright 2015 PariahSoft LLC **
+**********************************/
+
+// **********
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+// **********
+
+
+#include "area-binary.h"
+#include "area-prefetch.h"
+#include "area-tmx.h"
+#include "log.h"
+
+//! Most threads to read Areas with. Reading is mostly bound by the XML
+//! parser, and an Area rarely has more than a few neighbors.
+#define PREFETCH_MAX_THREADS 2
+
+static AreaPrefetcher globalAreaPrefetcher;
+
+AreaPrefetcher& AreaPrefetcher::instance()
+{
+	return globalAreaPrefetcher;
+}
+
+AreaPrefetcher::AreaPrefetcher()
+	: stopping(false)
+{
+}
+
+AreaPrefetcher::~AreaPrefetcher()
+{
+	stop();
+}
+
+void AreaPrefetcher::prefetch(const std::string& descriptor)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (stopping || entries.find(descriptor) != entries.end())
+		return;
+
+	entries[descriptor].done = false;
+	queue.push_back(descriptor);
+	if (workers.empty())
+		start();
+	queued.notify_one();
+}
+
+std::unique_ptr<AreaDesc> AreaPrefetcher::take(const std::string& descriptor)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	auto it = entries.find(descriptor);
+	if (it == entries.end())
+		return NULL;
+
+	// Still waiting in line? Then it's no faster to wait for a worker
+	// than to read it ourselves.
+	for (auto q = queue.begin(); q != queue.end(); q++) {
+		if (*q == descriptor) {
+			queue.erase(q);
+			entries.erase(it);
+			return NULL;
+		}
+	}
+
+	finished.wait(lock, [&] { return it->second.done; });
+
+	std::unique_ptr<AreaDesc> desc = std::move(it->second.desc);
+	entries.erase(it);
+	return desc;
+}
+
+bool AreaPrefetcher::nextReady(std::string* descriptor)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	for (auto& entry : entries) {
+		if (entry.second.done && entry.second.desc) {
+			*descriptor = entry.first;
+			return true;
+		}
+	}
+	return false;
+}
+
+void AreaPrefetcher::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		queue.clear();
+	}
+	queued.notify_all();
+
+	for (auto& worker : workers)
+		worker.join();
+	workers.clear();
+}
+
+void AreaPrefetcher::start()
+{
+	unsigned n = std::thread::hardware_concurrency();
+	if (n > PREFETCH_MAX_THREADS)
+		n = PREFETCH_MAX_THREADS;
+	if (n == 0)
+		n = 1;
+
+	for (unsigned i = 0; i < n; i++)
+		workers.push_back(std::thread(&AreaPrefetcher::work, this));
+}
+
+void AreaPrefetcher::work()
+{
+	Log::muteThread(true);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		queued.wait(lock, [&] { return stopping || !queue.empty(); });
+		if (stopping)
+			return;
+
+		std::string descriptor = queue.front();
+		queue.pop_front();
+		lock.unlock();
+
+		auto desc = std::make_unique<AreaDesc>();
+		bool ok = loadAreaBinary(descriptor, desc.get());
+		if (!ok) {
+			*desc = AreaDesc();
+			ok = parseTMX(descriptor, desc.get());
+		}
+
+		lock.lock();
+		Entry& entry = entries[descriptor];
+		entry.done = true;
+		if (ok)
+			entry.desc = std::move(desc);
+		finished.notify_all();
+	}
+}
+
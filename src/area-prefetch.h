@@ -0,0 +1,99 @@
+/**********************************
+** Tsunagari Tile Engine         **
+** area-prefetch.h               **
+** Copyright 2015 PariahSoft LLC **
+**********************************/
+
+// **********
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+// **********
+
+
+#ifndef AREA_PREFETCH_H
+#define AREA_PREFETCH_H
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "area-desc.h"
+
+/**
+ * Reads Areas the player might soon enter on background threads, so that
+ * walking through an exit doesn't have to wait for the disk and the XML
+ * parser. Only the reading into an AreaDesc happens off the main thread;
+ * building the Area itself loads images and must stay on the main thread.
+ *
+ * Errors found while reading ahead are not logged. An Area that could not
+ * be read is read again when it is needed, and its errors are reported
+ * then.
+ */
+class AreaPrefetcher
+{
+public:
+	//! Acquire the global AreaPrefetcher object.
+	static AreaPrefetcher& instance();
+
+	AreaPrefetcher();
+	~AreaPrefetcher();
+
+	//! Begin reading an Area in the background. Does nothing if it has
+	//! already been requested.
+	void prefetch(const std::string& descriptor);
+
+	//! Take an Area that was read in the background, waiting for it if
+	//! it is still being read. Returns NULL if the Area was never
+	//! requested or could not be read.
+	std::unique_ptr<AreaDesc> take(const std::string& descriptor);
+
+	//! Find an Area that finished reading successfully and has yet to be
+	//! taken. Returns false if there is none.
+	bool nextReady(std::string* descriptor);
+
+	//! Abandon waiting work and join the worker threads. Must be called
+	//! before the resources the workers use are torn down.
+	void stop();
+
+private:
+	AreaPrefetcher(const AreaPrefetcher&) = delete;
+	AreaPrefetcher& operator=(const AreaPrefetcher&) = delete;
+
+	struct Entry {
+		bool done;
+		std::unique_ptr<AreaDesc> desc;
+	};
+
+	void start();
+	void work();
+
+	std::mutex mutex;
+	std::condition_variable queued, finished;
+	std::deque<std::string> queue;
+	std::map<std::string, Entry> entries;
+	std::vector<std::thread> workers;
+	bool stopping;
+};
+
+#endif
+
@@ -24,24 +24,29 @@
 // IN THE SOFTWARE.
 // **********
 
-#include <cassert>
-#include <limits>
+#include <ctype.h>
 #include <math.h>
 #include <memory>
+#include <stdint.h>
+#include <string.h>
 #include <vector>
 
+#include <zlib.h>
+
+#include "area-binary.h"
+#include "area-prefetch.h"
 #include "area-tmx.h"
-#include "entity.h"
-#include "images.h"
+#include "client-conf.h"
+#include "formatter.h"
 #include "log.h"
-#include "resources.h"
 #include "string.h"
 #include "tile.h"
 #include "window.h"
-#include "world.h"
 
 #ifdef _WIN32
 	#include "os-windows.h"
+#else
+	#include <sys/resource.h>
 #endif
 
 #define ASSERT(x)  if (!(x)) { return false; }
@@ -56,8 +61,6 @@ AreaTMX::AreaTMX(Player* player,
            const std::string& descriptor)
 	: Area(player, descriptor)
 {
-	// Add TileType #0. Not used, but Tiled's gids start from 1.
-	gids.push_back(NULL);
 }
 
 AreaTMX::~AreaTMX()
@@ -66,41 +69,138 @@ AreaTMX::~AreaTMX()
 
 bool AreaTMX::init()
 {
-	return processDescriptor();
+	// Use the area as it was read in the background, if it was.
+	std::unique_ptr<AreaDesc> prefetched =
+		AreaPrefetcher::instance().take(descriptor);
+	if (prefetched)
+		return build(*prefetched);
+
+	// Prefer the compiled form of the area, if one was made with
+	// --compile-area.
+	AreaDesc desc;
+	if (!loadAreaBinary(descriptor, &desc)) {
+		desc = AreaDesc();
+		ASSERT(parseTMX(descriptor, &desc));
+	}
+	return build(desc);
 }
 
 
-void AreaTMX::allocateMapLayer()
+//! Reads a TMX file into an AreaDesc, either from an XMLDoc or, without
+//! building a tree, from an XMLStream.
+template <class Doc, class Node>
+class TMXParser
 {
-	assert(0 <= dim.y && dim.y <= std::numeric_limits<int>::max());
-	assert(0 <= dim.x && dim.x <= std::numeric_limits<int>::max());
-	assert(0 <= dim.z && dim.z + 1 <= std::numeric_limits<int>::max());
+public:
+	TMXParser(const std::string& descriptor, AreaDesc* desc);
+
+	//! Parse an Area file.
+	bool processDescriptor();
+
+private:
+	bool processMapProperties(Node node);
+	bool processTileSet(Node node);
+	bool processTileType(Node node, AreaDesc::TileTypeDesc& type);
+	bool processLayer(Node node);
+	bool processLayerProperties(Node node, double* depth);
+	bool processLayerData(Node node, AreaDesc::LayerDesc& layer);
+	bool processObjectGroup(Node node);
+	bool processObjectGroupProperties(Node node, double* depth);
+	bool processObject(Node node, int z);
+	bool splitTileFlags(const std::string& strOfFlags, unsigned* flags);
+	bool parseExit(const std::string& dest, Exit* exit,
+		bool* wwide, bool* hwide);
+	bool parseARGB(const std::string& str,
+		unsigned char& a, unsigned char& r,
+		unsigned char& g, unsigned char& b);
+
+	//! Index of the layer at a depth, or -1 if there is none.
+	int findLayer(double depth) const;
+
+	const std::string& descriptor;
+	AreaDesc* desc;
+};
 
-	map.push_back(grid_t((size_t)dim.y, row_t((size_t)dim.x)));
-	grid_t& grid = map[(size_t)dim.z];
-	for (int y = 0; y < dim.y; y++) {
-		row_t& row = grid[(size_t)y];
-		for (int x = 0; x < dim.x; x++) {
-			Tile& tile = row[(size_t)x];
-			new (&tile) Tile(this, x, y, dim.z);
-		}
+/**
+ * Peak resident set size of the process in KiB, or 0 where unsupported.
+ */
+static long peakRSS()
+{
+#ifdef _WIN32
+	return 0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage))
+		return 0;
+	#ifdef __APPLE__
+		return usage.ru_maxrss / 1024;
+	#else
+		return usage.ru_maxrss;
+	#endif
+#endif
+}
+
+bool parseTMX(const std::string& descriptor, AreaDesc* desc)
+{
+	time_t start = GameWindow::time();
+	long startRSS = peakRSS();
+	bool ok;
+
+	if (conf.streamTMX) {
+		TMXParser<XMLStream, XMLStreamNode> parser(descriptor, desc);
+		ok = parser.processDescriptor();
 	}
-	dim.z++;
+	else {
+		TMXParser<XMLDoc, XMLNode> parser(descriptor, desc);
+		ok = parser.processDescriptor();
+	}
+
+	Log::info(descriptor, Formatter("read % in % ms, peak RSS grew "
+		"by % KiB to % KiB") %
+		(conf.streamTMX ? "as a stream" : "into a tree") %
+		(GameWindow::time() - start) %
+		(peakRSS() - startRSS) % peakRSS());
+	return ok;
 }
 
-bool AreaTMX::processDescriptor()
+/**
+ * Open an XML document for a TMXParser. Trees are validated against the DTD
+ * of the given type. Streams are not.
+ */
+static bool openXML(const std::string& path, const std::string& dtdType,
+                    std::shared_ptr<XMLDoc>* doc, XMLNode* root)
 {
-	std::shared_ptr<XMLDoc> doc;
-	XMLNode root;
+	ASSERT(*doc = XMLs::instance().load(path, dtdType));
+	ASSERT(*root = (*doc)->root());
+	return true;
+}
 
-	ASSERT(doc = XMLs::instance().load(descriptor, "area"));
-	ASSERT(root = doc->root()); // <map>
+static bool openXML(const std::string& path, const std::string&,
+                    std::shared_ptr<XMLStream>* doc, XMLStreamNode* root)
+{
+	ASSERT(*doc = XMLs::instance().stream(path));
+	ASSERT(*root = (*doc)->root());
+	return true;
+}
 
-	ASSERT(root.intAttr("width", &dim.x));
-	ASSERT(root.intAttr("height", &dim.y));
-	dim.z = 0;
+template <class Doc, class Node>
+TMXParser<Doc, Node>::TMXParser(const std::string& descriptor, AreaDesc* desc)
+	: descriptor(descriptor), desc(desc)
+{
+}
 
-	for (XMLNode child = root.childrenNode(); child; child = child.next()) {
+template <class Doc, class Node>
+bool TMXParser<Doc, Node>::processDescriptor()
+{
+	std::shared_ptr<Doc> doc;
+	Node root;
+
+	ASSERT(openXML(descriptor, "area", &doc, &root)); // <map>
+
+	ASSERT(root.intAttr("width", &desc->dim.x));
+	ASSERT(root.intAttr("height", &desc->dim.y));
+
+	for (Node child = root.childrenNode(); child; child = child.next()) {
 		if (child.is("properties")) {
 			ASSERT(processMapProperties(child));
 		}
@@ -115,10 +215,12 @@ bool AreaTMX::processDescriptor()
 		}
 	}
 
-	return true;
+	// A stream only finds errors in the document as it reaches them.
+	return *doc;
 }
 
-bool AreaTMX::processMapProperties(XMLNode node)
+template <class Doc, class Node>
+bool TMXParser<Doc, Node>::processMapProperties(Node node)
 {
 
 /*
@@ -131,30 +233,27 @@ bool AreaTMX::processMapProperties(XMLNode node)
  </properties>
 */
 
-	musicIntroSet = false;
-	musicLoopSet = false;
-
-	for (XMLNode child = node.childrenNode(); child; child = child.next()) {
+	for (Node child = node.childrenNode(); child; child = child.next()) {
 		std::string name = child.attr("name");
 		std::string value = child.attr("value");
 		if (name == "name")
-			this->name = value;
+			desc->name = value;
 		else if (name == "intro_music") {
-			musicIntro = value;
-			musicIntroSet = true;
+			desc->musicIntro = value;
+			desc->musicIntroSet = true;
 		}
 		else if (name == "main_music") {
-			musicLoop = value;
-			musicLoopSet = true;
+			desc->musicLoop = value;
+			desc->musicLoopSet = true;
 		}
 		else if (name == "loop") {
-			loopX = value.find('x') != std::string::npos;
-			loopY = value.find('y') != std::string::npos;
+			desc->loopX = value.find('x') != std::string::npos;
+			desc->loopY = value.find('y') != std::string::npos;
 		}
 		else if (name == "color_overlay") {
 			unsigned char a, r, g, b;
 			ASSERT(parseARGB(value, a, r, g, b));
-			colorOverlayARGB =
+			desc->colorOverlayARGB =
 				(uint32_t)(a << 24) + (uint32_t)(r << 16) +
 				(uint32_t)(g <<  8) + (uint32_t)b;
 		}
@@ -175,7 +274,8 @@ static std::string dirname(const std::string& path)
 	return slash == std::string::npos ? "" : path.substr(0, slash + 1);
 }
 
-bool AreaTMX::processTileSet(XMLNode node)
+template <class Doc, class Node>
+bool TMXParser<Doc, Node>::processTileSet(Node node)
 {
 
 /*
@@ -187,18 +287,17 @@ bool AreaTMX::processTileSet(XMLNode node)
  </tileset>
 */
 
-	std::shared_ptr<XMLDoc> doc;
+	std::shared_ptr<Doc> doc;
 	std::string source;
 
-	TileSet* set = NULL;
-	std::shared_ptr<TiledImage> img;
+	AreaDesc::TileSetDesc set;
+	bool imageFound = false;
 	int tilex, tiley;
-	int firstGid;
 
 	// Read firstgid from original node.
-	ASSERT(node.intAttr("firstgid", &firstGid));
+	ASSERT(node.intAttr("firstgid", &set.firstGid));
 
-	if (firstGid < 0) {
+	if (set.firstGid < 0) {
 		Log::err(descriptor, "first gid is invalid");
 		return false;
 	}
@@ -209,89 +308,66 @@ bool AreaTMX::processTileSet(XMLNode node)
 	source = node.attr("source");
 	if (source.size()) {
 		source = dirname(descriptor) + source;
-		if (!(doc = XMLs::instance().load(source, "tsx"))) {
+		set.tsxSource = source;
+		if (!openXML(source, "tsx", &doc, &node)) { // <tileset>
 			Log::err(descriptor, source + ": failed to load valid TSX file");
 			return false;
 		}
-		ASSERT(node = doc->root()); // <tileset>
 	}
 
 	ASSERT(node.intAttr("tilewidth", &tilex));
 	ASSERT(node.intAttr("tileheight", &tiley));
 
-	if (tileDim && tileDim != ivec2(tilex, tiley)) {
+	if (desc->tileDim && desc->tileDim != ivec2(tilex, tiley)) {
 		Log::err(descriptor,
 			"<tileset>'s width/height contradict earlier <layer>");
 		return false;
 	}
-	tileDim = ivec2(tilex, tiley);
+	desc->tileDim = ivec2(tilex, tiley);
 
-	for (XMLNode child = node.childrenNode(); child; child = child.next()) {
+	for (Node child = node.childrenNode(); child; child = child.next()) {
 		if (child.is("image")) {
 			int pixelw, pixelh;
 			ASSERT(child.intAttr("width", &pixelw) &&
 			       child.intAttr("height", &pixelh));
-			int width = pixelw / tileDim.x;
-			int height = pixelh / tileDim.y;
-
-			assert(0 <= width);
-			assert(0 <= height);
-
-			std::string imgSource = dirname(source) + child.attr("source");
-			tileSets[imgSource] = TileSet((size_t)width,
-				(size_t)height);
-			set = &tileSets[imgSource];
-
-			// Load tileset image.
-			img = Images::instance().loadTiles(imgSource, tilex, tiley);
-			if (!img) {
-				Log::err(descriptor, "tileset image not found");
-				return false;
-			}
-
-			// Initialize "vanilla" tile type array.
-			for (size_t i = 0; i < img->size(); i++) {
-				auto& tileImg = (*img.get())[i];
-				TileType* type = new TileType(tileImg);
-				set->add(type);
-				gids.push_back(type);
-			}
+			set.width = pixelw / tilex;
+			set.height = pixelh / tiley;
+			set.imgSource = dirname(source) + child.attr("source");
+			imageFound = true;
 		}
 		else if (child.is("tile")) {
 			// Handle an explicitly declared "non-vanilla" type.
 
-			if (!img) {
+			if (!imageFound) {
 				Log::err(descriptor,
 				  "Tile type processed before tileset image loaded");
 				return false;
 			}
 
 			// "id" is 0-based index of a tile in the current
-			// tileset, if the tileset were a flat array.
-			int id;
-			ASSERT(child.intAttr("id", &id));
-
-			if (id < 0 || (int)img->size() <= id) {
-				Log::err(descriptor, "tile type id is invalid");
-				return false;
-			}
-
-			// Initialize a default TileType, we'll build on that.
-			TileType* type = new TileType((*img.get())[(size_t)id]);
-			ASSERT(processTileType(child, *type, img, id));
-			// "gid" is the global area-wide id of the tile.
-			size_t gid = (size_t)id + (size_t)firstGid;
-			delete gids[gid]; // "vanilla" type
-			gids[gid] = type;
-			set->set((size_t)id, type);
+			// tileset, if the tileset were a flat array. It is
+			// checked against the image once that is loaded.
+			AreaDesc::TileTypeDesc type;
+			ASSERT(child.intAttr("id", &type.id));
+			ASSERT(processTileType(child, type));
+			set.types.push_back(type);
 		}
 	}
 
+	if (doc && !*doc)
+		return false;
+	if (!imageFound) {
+		Log::err(descriptor, "<tileset> has no image");
+		return false;
+	}
+
+	desc->tileSets.push_back(std::move(set));
 	return true;
 }
 
-bool AreaTMX::processTileType(XMLNode node, TileType& type,
-		std::shared_ptr<TiledImage>& img, int id)
+template <class Doc, class Node>
+bool TMXParser<Doc, Node>::processTileType(Node node,
+                                           AreaDesc::TileTypeDesc& type)
 {
 
 /*
@@ -314,12 +390,7 @@ bool AreaTMX::processTileType(XMLNode node, TileType& type,
 	// The id has already been handled by processTileSet, so we don't have
 	// to worry about it.
 
-	// If a Tile is animated, it needs both member frames and a speed.
-	std::vector<std::shared_ptr<Image>> framesvec;
-	int cycles = ANIM_INFINITE_CYCLES;
-	int frameLen = -1;
-
-	XMLNode child = node.childrenNode(); // <properties>
+	Node child = node.childrenNode(); // <properties>
 	for (child = child.childrenNode(); child; child = child.next()) {
 		// Each <property>...
 		std::string name = child.attr("name");
@@ -328,70 +399,55 @@ bool AreaTMX::processTileType(XMLNode node, TileType& type,
 			ASSERT(splitTileFlags(value, &type.flags));
 		}
 		else if (name == "on_enter") {
-			std::string scriptName = value;
-			type.enterScript = dataArea->script(scriptName);
+			type.enterScript = value;
 		}
 		else if (name == "on_leave") {
-			std::string scriptName = value;
-			type.leaveScript = dataArea->script(scriptName);
+			type.leaveScript = value;
 		}
 		else if (name == "on_use") {
-			std::string scriptName = value;
-			type.useScript = dataArea->script(scriptName);
+			type.useScript = value;
 		}
 		else if (name == "frames") {
-			std::string memtemp;
-			std::vector<std::string> frames;
-			std::vector<std::string>::iterator it;
-			memtemp = value;
-			frames = splitStr(memtemp, ",");
+			std::vector<std::string> frames = splitStr(value, ",");
 
 			// Make sure the first member is this tile.
-			if (atoi(frames[0].c_str()) != id) {
+			if (atoi(frames[0].c_str()) != type.id) {
 				Log::err(descriptor, "first member of tile"
-					" id " + itostr(id) +
+					" id " + itostr(type.id) +
 					" animation must be itself.");
 				return false;
 			}
 
-			// Add frames to our animation.
-			// We already have one from TileType's constructor.
-			for (it = frames.begin(); it < frames.end(); it++) {
-				int idx = atoi(it->c_str());
-				if (idx < 0 || (int)img->size() <= idx) {
-					Log::err(descriptor, "frame index out "
-						"of range for animated tile");
-					return false;
-				}
-				framesvec.push_back((*img.get())[(size_t)idx]);
-			}
+			// Frames are checked against the tileset image once
+			// it is loaded.
+			type.frames.clear();
+			for (auto it = frames.begin(); it < frames.end(); it++)
+				type.frames.push_back(atoi(it->c_str()));
 		}
 		else if (name == "speed") {
 			double hertz;
 			ASSERT(child.doubleAttr("value", &hertz));
-			frameLen = (int)(1000.0/hertz);
+			type.frameLen = (int)(1000.0/hertz);
 		}
 		else if (name == "cycles") {
-			ASSERT(child.intAttr("value", &cycles));
+			ASSERT(child.intAttr("value", &type.cycles));
 		}
 	}
 
-	if (framesvec.size() || frameLen != -1) {
-		if (framesvec.empty() || frameLen == -1) {
+	// If a Tile is animated, it needs both member frames and a speed.
+	if (type.frames.size() || type.frameLen != -1) {
+		if (type.frames.empty() || type.frameLen == -1) {
 			Log::err(descriptor, "tile type must either have both "
 				"frames and speed or none");
 			return false;
 		}
-		// Add 'now' to Animation constructor??
-		time_t now = World::instance().time();
-		type.anim = Animation(framesvec, frameLen);
-		type.anim.startOver(now, cycles);
 	}
 
 	return true;
 }
 
-bool AreaTMX::processLayer(XMLNode node)
+template <class Doc, class Node>
+bool TMXParser<Doc, Node>::processLayer(Node node)
 {
 
 /*
@@ -412,30 +468,38 @@ bool AreaTMX::processLayer(XMLNode node)
 */
 
 	int x, y;
-	double depth;
 	ASSERT(node.intAttr("width", &x));
 	ASSERT(node.intAttr("height", &y));
 
-	if (dim.x != x || dim.y != y) {
+	if (desc->dim.x != x || desc->dim.y != y) {
 		Log::err(descriptor, "layer x,y size != map x,y size");
 		return false;
 	}
 
-	allocateMapLayer();
+	AreaDesc::LayerDesc layer;
+	bool depthFound = false;
 
-	for (XMLNode child = node.childrenNode(); child; child = child.next()) {
+	for (Node child = node.childrenNode(); child; child = child.next()) {
 		if (child.is("properties")) {
-			ASSERT(processLayerProperties(child, &depth));
+			ASSERT(processLayerProperties(child, &layer.depth));
+			depthFound = true;
 		}
 		else if (child.is("data")) {
-			ASSERT(processLayerData(child, dim.z - 1));
+			ASSERT(processLayerData(child, layer));
 		}
 	}
 
+	if (!depthFound) {
+		Log::err(descriptor, "<layer> must have layer property");
+		return false;
+	}
+
+	desc->layers.push_back(std::move(layer));
 	return true;
 }
 
-bool AreaTMX::processLayerProperties(XMLNode node, double* depth)
+template <class Doc, class Node>
+bool TMXParser<Doc, Node>::processLayerProperties(Node node, double* depth)
 {
 
 /*
@@ -446,21 +510,17 @@ bool AreaTMX::processLayerProperties(XMLNode node, double* depth)
 
 	bool layerFound = false;
 
-	for (XMLNode child = node.childrenNode(); child; child = child.next()) {
+	for (Node child = node.childrenNode(); child; child = child.next()) {
 		std::string name  = child.attr("name");
 		std::string value = child.attr("value");
 		if (name == "layer") {
 			layerFound = true;
 			ASSERT(child.doubleAttr("value", depth));
-			if (depth2idx.find(*depth) != depth2idx.end()) {
+			if (findLayer(*depth) != -1) {
 				Log::err(descriptor,
 				         "depth used multiple times");
 				return false;
 			}
-
-			depth2idx[*depth] = dim.z - 1;
-			idx2depth.push_back(*depth);
-			// Effectively idx2depth[dim.z - 1] = depth;
 		}
 	}
 
@@ -469,7 +529,167 @@ bool AreaTMX::processLayerProperties(XMLNode node, double* depth)
 	return layerFound;
 }
 
-bool AreaTMX::processLayerData(XMLNode node, int z)
+/**
+ * Values of base64 digits, indexed by character. Anything that is not a digit
+ * is BASE64_INVALID.
+ */
+#define BASE64_INVALID 0xFF
+
+struct Base64Table
+{
+	Base64Table();
+
+	unsigned char values[256];
+};
+
+Base64Table::Base64Table()
+{
+	const char* digits =
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	memset(values, BASE64_INVALID, sizeof(values));
+	for (unsigned char i = 0; i < 64; i++)
+		values[(unsigned char)digits[i]] = i;
+}
+
+static const Base64Table base64;
+
+/**
+ * Decode base64, skipping whitespace. Whole groups of four digits are decoded
+ * with one table lookup each and no branching per character, which covers
+ * everything but the line breaks Tiled puts around the data.
+ */
+static bool decodeBase64(const std::string& in, std::string* out)
+{
+	const unsigned char* p = (const unsigned char*)in.data();
+	const unsigned char* end = p + in.size();
+	const unsigned char* v = base64.values;
+
+	out->clear();
+	out->reserve(in.size() / 4 * 3);
+
+	uint32_t bits = 0;
+	int digits = 0;
+
+	while (p < end) {
+		if (digits == 0 && end - p >= 4) {
+			uint32_t a = v[p[0]], b = v[p[1]], c = v[p[2]], d = v[p[3]];
+			if ((a | b | c | d) < 64) {
+				uint32_t group = a << 18 | b << 12 | c << 6 | d;
+				char bytes[3] = {
+					(char)(group >> 16),
+					(char)(group >> 8),
+					(char)group
+				};
+				out->append(bytes, 3);
+				p += 4;
+				continue;
+			}
+		}
+
+		unsigned char c = *p++;
+		if (isspace(c))
+			continue;
+		if (c == '=')
+			break;
+		if (v[c] == BASE64_INVALID)
+			return false;
+
+		bits = bits << 6 | v[c];
+		if (++digits == 4) {
+			out->push_back((char)(bits >> 16));
+			out->push_back((char)(bits >> 8));
+			out->push_back((char)bits);
+			bits = 0;
+			digits = 0;
+		}
+	}
+
+	// A trailing partial group holds one or two bytes.
+	if (digits == 1)
+		return false;
+	if (digits == 2)
+		out->push_back((char)(bits >> 4));
+	if (digits == 3) {
+		out->push_back((char)(bits >> 10));
+		out->push_back((char)(bits >> 2));
+	}
+	return true;
+}
+
+/**
+ * Inflate zlib or gzip data that is expected to be the given size. Fails if
+ * the data is corrupt or inflates to more than that.
+ */
+static bool inflateData(const std::string& in, size_t size, std::string* out)
+{
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+
+	// Adding 32 to the window size has zlib detect either header.
+	if (inflateInit2(&zs, 15 + 32) != Z_OK)
+		return false;
+
+	out->resize(size);
+	zs.next_in = (Bytef*)in.data();
+	zs.avail_in = (uInt)in.size();
+	zs.next_out = (Bytef*)&(*out)[0];
+	zs.avail_out = (uInt)out->size();
+
+	int err = inflate(&zs, Z_FINISH);
+	out->resize(zs.total_out);
+	inflateEnd(&zs);
+
+	return err == Z_STREAM_END;
+}
+
+/**
+ * Convert an array of little-endian 32-bit gids.
+ */
+static bool bytesToGids(const std::string& bytes, std::vector<uint32_t>& gids)
+{
+	if (bytes.size() % 4)
+		return false;
+
+	const unsigned char* b = (const unsigned char*)bytes.data();
+	size_t cnt = bytes.size() / 4;
+
+	gids.resize(cnt);
+	for (size_t i = 0; i < cnt; i++, b += 4)
+		gids[i] = (uint32_t)b[0] | (uint32_t)b[1] << 8 |
+		          (uint32_t)b[2] << 16 | (uint32_t)b[3] << 24;
+	return true;
+}
+
+/**
+ * Parse comma-separated gids, skipping whitespace. Digits are accumulated in
+ * place rather than split into strings first.
+ */
+static bool decodeCSV(const std::string& in, std::vector<uint32_t>& gids)
+{
+	const char* p = in.data();
+	const char* end = p + in.size();
+
+	while (p < end) {
+		if (*p == ',' || isspace((unsigned char)*p)) {
+			p++;
+			continue;
+		}
+		if (!isdigit((unsigned char)*p))
+			return false;
+
+		uint64_t gid = 0;
+		for (; p < end && isdigit((unsigned char)*p); p++) {
+			gid = gid * 10 + (uint64_t)(*p - '0');
+			if (gid > UINT32_MAX)
+				return false;
+		}
+		gids.push_back((uint32_t)gid);
+	}
+	return true;
+}
+
+template <class Doc, class Node>
+bool TMXParser<Doc, Node>::processLayerData(Node node, AreaDesc::LayerDesc& layer)
 {
 
 /*
@@ -482,42 +702,89 @@ bool AreaTMX::processLayerData(XMLNode node, int z)
    <tile gid="9"/>
    <tile gid="9"/>
   </data>
+
+  <data encoding="csv">
+   9,9,9,...,3,9,9
+  </data>
+
+  <data encoding="base64" compression="zlib">
+   eJxjZGBgYBzFo3gUj+JRPIpH8Sge...
+  </data>
 */
 
-	assert(0 <= z && z < dim.z);
+	size_t cells = (size_t)desc->dim.x * (size_t)desc->dim.y;
+	std::string encoding = node.attr("encoding");
+	std::string compression = node.attr("compression");
 
-	size_t x = 0, y = 0;
+	layer.gids.reserve(cells);
 
-	for (XMLNode child = node.childrenNode(); child; child = child.next()) {
-		if (child.is("tile")) {
-			int gid;
-			ASSERT(child.intAttr("gid", &gid));
+	if (encoding.empty()) {
+		for (Node child = node.childrenNode(); child;
+		     child = child.next()) {
+			if (child.is("tile")) {
+				int gid;
+				ASSERT(child.intAttr("gid", &gid));
 
-			if (gid < 0 || (int)gids.size() <= gid) {
-				Log::err(descriptor, "invalid tile gid");
-				return false;
-			}
+				// Gids are checked against the tilesets once
+				// their images are loaded.
+				if (gid < 0) {
+					Log::err(descriptor, "invalid tile gid");
+					return false;
+				}
 
-			// A gid of zero means there is no tile at this
-			// position on this layer.
-			if (gid > 0) {
-				TileType* type = gids[(size_t)gid];
-				Tile& tile = map[(size_t)z][y][x];
-				type->allOfType.push_back(&tile);
-				tile.parent = type;
+				// A gid of zero means there is no tile at this
+				// position on this layer.
+				layer.gids.push_back((uint32_t)gid);
 			}
+		}
+		return true;
+	}
 
-			if (++x == (size_t)dim.x) {
-				x = 0;
-				y++;
+	if (encoding == "csv" && compression.empty()) {
+		if (!decodeCSV(node.content(), layer.gids)) {
+			Log::err(descriptor, "invalid CSV layer data");
+			return false;
+		}
+	}
+	else if (encoding == "base64") {
+		std::string bytes, inflated;
+		if (!decodeBase64(node.content(), &bytes)) {
+			Log::err(descriptor, "invalid base64 layer data");
+			return false;
+		}
+		if (compression == "zlib" || compression == "gzip") {
+			if (!inflateData(bytes, cells * 4, &inflated)) {
+				Log::err(descriptor, "invalid " + compression +
+					" layer data");
+				return false;
 			}
+			bytes.swap(inflated);
+		}
+		else if (compression.size()) {
+			Log::err(descriptor, "unsupported layer compression: " +
+				compression);
+			return false;
 		}
+		if (!bytesToGids(bytes, layer.gids)) {
+			Log::err(descriptor, "invalid base64 layer data");
+			return false;
+		}
+	}
+	else {
+		Log::err(descriptor, "unsupported layer encoding: " + encoding);
+		return false;
+	}
+
+	if (layer.gids.size() != cells) {
+		Log::err(descriptor, "layer data size != map x,y size");
+		return false;
 	}
 
 	return true;
 }
 
-bool AreaTMX::processObjectGroup(XMLNode node)
+template <class Doc, class Node>
+bool TMXParser<Doc, Node>::processObjectGroup(Node node)
 {
 
 /*
@@ -544,18 +811,18 @@ bool AreaTMX::processObjectGroup(XMLNode node)
 
 	double depth = invalid;
 
-	if (x && y && (dim.x != x || dim.y != y)) {
+	if (x && y && (desc->dim.x != x || desc->dim.y != y)) {
 		Log::err(descriptor, "objectgroup x,y size != map x,y size");
 		return false;
 	}
 
-	for (XMLNode child = node.childrenNode(); child; child = child.next()) {
+	for (Node child = node.childrenNode(); child; child = child.next()) {
 		if (child.is("properties")) {
 			ASSERT(processObjectGroupProperties(child, &depth));
 		}
 		else if (child.is("object")) {
 			ASSERT(depth != invalid);
-			int z = depth2idx[depth];
+			int z = findLayer(depth);
 			ASSERT(processObject(child, z));
 		}
 	}
@@ -563,7 +830,8 @@ bool AreaTMX::processObjectGroup(XMLNode node)
 	return true;
 }
 
-bool AreaTMX::processObjectGroupProperties(XMLNode node, double* depth)
+template <class Doc, class Node>
+bool TMXParser<Doc, Node>::processObjectGroupProperties(Node node, double* depth)
 {
 
 /*
@@ -573,17 +841,17 @@ bool AreaTMX::processObjectGroupProperties(XMLNode node, double* depth)
 */
 	bool layerFound = false;
 
-	for (XMLNode child = node.childrenNode(); child; child = child.next()) {
+	for (Node child = node.childrenNode(); child; child = child.next()) {
 		std::string name = child.attr("name");
 		std::string value = child.attr("value");
 		if (name == "layer") {
 			layerFound = true;
 			ASSERT(child.doubleAttr("value", depth));
-			if (depth2idx.find(*depth) == depth2idx.end()) {
-				allocateMapLayer();
-				depth2idx[*depth] = dim.z - 1;
-				idx2depth.push_back(*depth);
-				// Effectively idx2depth[dim.z - 1] = depth;
+			if (findLayer(*depth) == -1) {
+				// A layer with no Tiles of its own.
+				AreaDesc::LayerDesc layer;
+				layer.depth = *depth;
+				desc->layers.push_back(std::move(layer));
 			}
 		}
 	}
@@ -593,7 +861,8 @@ bool AreaTMX::processObjectGroupProperties(XMLNode node, double* depth)
 	return layerFound;
 }
 
-bool AreaTMX::processObject(XMLNode node, int z)
+template <class Doc, class Node>
+bool TMXParser<Doc, Node>::processObject(Node node, int z)
 {
 
 /*
@@ -611,18 +880,43 @@ bool AreaTMX::processObject(XMLNode node, int z)
   </object>
 */
 
-	assert(0 <= z && z < dim.z);
+	AreaDesc::ObjectDesc obj;
+	obj.z = z;
+
+	// Record the rectangle of the map these properties apply to. We don't
+	// keep an intermediary "object" object around once the Area is built.
+	// Attributes come first, as a stream cannot return to them once the
+	// properties are read.
+	ASSERT(node.intAttr("x", &obj.x));
+	ASSERT(node.intAttr("y", &obj.y));
+
+	obj.x /= desc->tileDim.x;
+	obj.y /= desc->tileDim.y;
+
+	if (node.hasAttr("gid")) {
+		// This is one of Tiled's "Tile Objects". It is one tile wide
+		// and high.
 
-	// Gather object properties now. Assign them to tiles later.
-	bool wwide[5], hwide[5]; /* wide exit in dimensions: width, height */
+		// Bug in tiled. The y is off by one. The author of the format
+		// knows about this, but it will not change.
+		obj.y = obj.y - 1;
+		obj.w = 1;
+		obj.h = 1;
 
-	DataArea::TileScript enterScript = NULL, leaveScript = NULL,
-		useScript = NULL;
-	std::unique_ptr<Exit> exit[5];
-	std::unique_ptr<double> layermods[5];
-	unsigned flags = 0x0;
+		// We don't actually use the object gid. It is supposed to
+		// indicate which tile our object is rendered as, but for
+		// Tsunagari, tile objects are always transparent and reveal
+		// the tile below.
+	}
+	else {
+		// This is one of Tiled's "Objects". It has a width and height.
+		ASSERT(node.intAttr("width", &obj.w));
+		ASSERT(node.intAttr("height", &obj.h));
+		obj.w /= desc->tileDim.x;
+		obj.h /= desc->tileDim.y;
+	}
 
-	XMLNode child = node.childrenNode(); // <properties>
+	Node child = node.childrenNode(); // <properties>
 	if (!child) {
 		// Empty <object> element. Odd, but acceptable.
 		return true;
@@ -631,138 +925,68 @@ bool AreaTMX::processObject(XMLNode node, int z)
 		// Each <property>...
 		std::string name = child.attr("name");
 		std::string value = child.attr("value");
+
+		// Exits and layermods come in one flavor per ExitDirection.
+		ExitDirection dir = EXITS_LENGTH;
+		std::string kind = name, suffix;
+		size_t colon = name.find(':');
+		if (colon != std::string::npos) {
+			kind = name.substr(0, colon);
+			suffix = name.substr(colon + 1);
+		}
+		if (suffix == "")
+			dir = EXIT_NORMAL;
+		else if (suffix == "up")
+			dir = EXIT_UP;
+		else if (suffix == "down")
+			dir = EXIT_DOWN;
+		else if (suffix == "left")
+			dir = EXIT_LEFT;
+		else if (suffix == "right")
+			dir = EXIT_RIGHT;
+
 		if (name == "flags") {
-			ASSERT(splitTileFlags(value, &flags));
+			ASSERT(splitTileFlags(value, &obj.flags));
 		}
 		else if (name == "on_enter") {
-			std::string scriptName = value;
-			enterScript = dataArea->script(scriptName);
+			obj.enterScript = value;
 		}
 		else if (name == "on_leave") {
-			std::string scriptName = value;
-			leaveScript = dataArea->script(scriptName);
+			obj.leaveScript = value;
 		}
 		else if (name == "on_use") {
-			std::string scriptName = value;
-			useScript = dataArea->script(scriptName);
-		}
-		else if (name == "exit") {
-			exit[EXIT_NORMAL].reset(new Exit);
-			ASSERT(parseExit(value, exit[EXIT_NORMAL].get(), &wwide[EXIT_NORMAL], &hwide[EXIT_NORMAL]));
-			flags |= TILE_NOWALK_NPC;
-		}
-		else if (name == "exit:up") {
-			exit[EXIT_UP].reset(new Exit);
-			ASSERT(parseExit(value, exit[EXIT_UP].get(), &wwide[EXIT_UP], &hwide[EXIT_UP]));
-		}
-		else if (name == "exit:down") {
-			exit[EXIT_DOWN].reset(new Exit);
-			ASSERT(parseExit(value, exit[EXIT_DOWN].get(), &wwide[EXIT_DOWN], &hwide[EXIT_DOWN]));
-		}
-		else if (name == "exit:left") {
-			exit[EXIT_LEFT].reset(new Exit);
-			ASSERT(parseExit(value, exit[EXIT_LEFT].get(), &wwide[EXIT_LEFT], &hwide[EXIT_LEFT]));
-		}
-		else if (name == "exit:right") {
-			exit[EXIT_RIGHT].reset(new Exit);
-			ASSERT(parseExit(value, exit[EXIT_RIGHT].get(), &wwide[EXIT_RIGHT], &hwide[EXIT_RIGHT]));
-		}
-		else if (name == "layermod") {
-			double mod;
-			ASSERT(child.doubleAttr("value", &mod));
-			layermods[EXIT_NORMAL].reset(new double(mod));
-			flags |= TILE_NOWALK_NPC;
-		}
-		else if (name == "layermod:up") {
-			double mod;
-			ASSERT(child.doubleAttr("value", &mod));
-			layermods[EXIT_UP].reset(new double(mod));
-		}
-		else if (name == "layermod:down") {
-			double mod;
-			ASSERT(child.doubleAttr("value", &mod));
-			layermods[EXIT_DOWN].reset(new double(mod));
-		}
-		else if (name == "layermod:left") {
-			double mod;
-			ASSERT(child.doubleAttr("value", &mod));
-			layermods[EXIT_LEFT].reset(new double(mod));
+			obj.useScript = value;
 		}
-		else if (name == "layermod:right") {
-			double mod;
-			ASSERT(child.doubleAttr("value", &mod));
-			layermods[EXIT_RIGHT].reset(new double(mod));
+		else if (kind == "exit" && dir != EXITS_LENGTH) {
+			obj.hasExit[dir] = true;
+			ASSERT(parseExit(value, &obj.exits[dir],
+			                 &obj.wwide[dir], &obj.hwide[dir]));
+			if (dir == EXIT_NORMAL)
+				obj.flags |= TILE_NOWALK_NPC;
 		}
-	}
-
-	// Apply these properties directly to one or more tiles in a rectangle
-	// of the map. We don't keep an intermediary "object" object lying
-	// around.
-	int x, y, w, h;
-	ASSERT(node.intAttr("x", &x));
-	ASSERT(node.intAttr("y", &y));
-
-	x /= tileDim.x;
-	y /= tileDim.y;
-
-	assert(0 <= x && x < dim.x);
-	assert(0 <= y && y < dim.y);
-
-	if (node.hasAttr("gid")) {
-		// This is one of Tiled's "Tile Objects". It is one tile wide
-		// and high.
-
-		// Bug in tiled. The y is off by one. The author of the format
-		// knows about this, but it will not change.
-		y = y - 1;
-		w = 1;
-		h = 1;
-
-		// We don't actually use the object gid. It is supposed to
-		// indicate which tile our object is rendered as, but for
-		// Tsunagari, tile objects are always transparent and reveal
-		// the tile below.
-	}
-	else {
-		// This is one of Tiled's "Objects". It has a width and height.
-		ASSERT(node.intAttr("width", &w));
-		ASSERT(node.intAttr("height", &h));
-		w /= tileDim.x;
-		h /= tileDim.y;
-
-		assert(0 < w && w <= dim.x);
-		assert(0 < h && h <= dim.y);
-	}
-
-	// We know which Tiles are being talked about now... yay
-	for (int Y = y; Y < y + h; Y++) {
-		for (int X = x; X < x + w; X++) {
-			Tile& tile = map[(size_t)z][(size_t)Y][(size_t)X];
-
-			tile.flags |= flags;
-			for (size_t i = 0; i < 5; i++) {
-				if (exit[i]) {
-					tile.exits[i] = new Exit(*exit[i].get());
-					int dx = X - x;
-					int dy = Y - y;
-					if (wwide[i])
-						tile.exits[i]->coords.x += dx;
-					if (hwide[i])
-						tile.exits[i]->coords.y += dy;
-				}
-			}
-			for (size_t i = 0; i < 5; i++)
-				tile.layermods[i] = layermods[i] ? new double(*layermods[i].get()) : NULL;
-			tile.enterScript = enterScript;
-			tile.leaveScript = leaveScript;
-			tile.useScript = useScript;
+		else if (kind == "layermod" && dir != EXITS_LENGTH) {
+			obj.hasLayermod[dir] = true;
+			ASSERT(child.doubleAttr("value", &obj.layermods[dir]));
+			if (dir == EXIT_NORMAL)
+				obj.flags |= TILE_NOWALK_NPC;
 		}
 	}
 
+	desc->objects.push_back(std::move(obj));
 	return true;
 }
 
-bool AreaTMX::splitTileFlags(const std::string& strOfFlags, unsigned* flags)
+template <class Doc, class Node>
+int TMXParser<Doc, Node>::findLayer(double depth) const
+{
+	for (size_t i = 0; i < desc->layers.size(); i++)
+		if (desc->layers[i].depth == depth)
+			return (int)i;
+	return -1;
+}
+
+template <class Doc, class Node>
+bool TMXParser<Doc, Node>::splitTileFlags(const std::string& strOfFlags, unsigned* flags)
 {
 	typedef std::vector<std::string> StringVector;
 	StringVector strs = splitStr(strOfFlags, ",");
@@ -812,7 +1036,8 @@ static bool isIntegerOrPlus(const std::string& s)
 	return true;
 }
 
-bool AreaTMX::parseExit(const std::string& dest, Exit* exit,
+template <class Doc, class Node>
+bool TMXParser<Doc, Node>::parseExit(const std::string& dest, Exit* exit,
 	bool* wwide, bool* hwide)
 {
 
@@ -851,7 +1076,8 @@ bool AreaTMX::parseExit(const std::string& dest, Exit* exit,
 	return true;
 }
 
-bool AreaTMX::parseARGB(const std::string& str,
+template <class Doc, class Node>
+bool TMXParser<Doc, Node>::parseARGB(const std::string& str,
 	unsigned char& a, unsigned char& r,
 	unsigned char& g, unsigned char& b)
 {
@@ -30,11 +30,12 @@
 #include <string>
 
 #include "area.h"
-#include "tile.h"
+#include "area-desc.h"
 #include "xmls.h"
 
 class Player;
 
+//! An Area read from a TMX map file made in Tiled, or from its compiled form.
 class AreaTMX : public Area
 {
 public:
@@ -44,32 +45,11 @@ public:
 	//! Parse the file specified in the constructor, generating a full Area
 	//! object. Must be called before use.
 	virtual bool init();
-
-private:
-	//! Allocate Tile objects for one layer of map.
-	void allocateMapLayer();
-
-	//! Parse an Area file.
-	bool processDescriptor();
-	bool processMapProperties(XMLNode node);
-	bool processTileSet(XMLNode node);
-	bool processTileType(XMLNode node, TileType& type,
-			std::shared_ptr<TiledImage>& img, int id);
-	bool processLayer(XMLNode node);
-	bool processLayerProperties(XMLNode node, double* depth);
-	bool processLayerData(XMLNode node, int z);
-	bool processObjectGroup(XMLNode node);
-	bool processObjectGroupProperties(XMLNode node, double* depth);
-	bool processObject(XMLNode node, int z);
-	bool splitTileFlags(const std::string& strOfFlags, unsigned* flags);
-	bool parseExit(const std::string& dest, Exit* exit,
-		bool* wwide, bool* hwide);
-	bool parseARGB(const std::string& str,
-		unsigned char& a, unsigned char& r,
-		unsigned char& g, unsigned char& b);
-
-	std::vector<TileType*> gids;
 };
 
+//! Parse a TMX map, along with any TSX tilesets it refers to. No images are
+//! loaded and no scripts are looked up.
+bool parseTMX(const std::string& descriptor, AreaDesc* desc);
+
 #endif
 
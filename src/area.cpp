@@ -25,6 +25,9 @@
 // **********
 
 #include <algorithm>
+#include <cassert>
+#include <limits.h>
+#include <limits>
 #include <math.h>
 
 #include "algorithm.h"
@@ -40,6 +43,7 @@
 #include "overlay.h"
 #include "player.h"
 #include "tile.h"
+#include "tilesets.h"
 #include "viewport.h"
 #include "window.h"
 #include "world.h"
@@ -48,17 +52,60 @@
 
 #define ASSERT(x)  if (!(x)) { return false; }
 
+//! Estimated memory kept by a baked strip for each Image drawn into it. A
+//! recording holds a list of textured quads rather than pixels, and Gosu
+//! keeps four vertices of position, texture coordinates and color per quad.
+#define BAKED_DRAW_BYTES 96
+
+//! Number of draw()s a baked strip may go unused before it is forgotten.
+//! About two seconds, so that walking back and forth across a chunk edge
+//! doesn't rebake.
+#define BAKED_STRIP_MAX_AGE 120
+
 /* NOTE: In the TMX map format used by Tiled, tileset tiles start counting
          their Y-positions from 0, while layer tiles start counting from 1. I
          can't imagine why the author did this, but we have to take it into
          account.
 */
 
+static int ivec2_to_dir(ivec2 v)
+{
+	switch (v.x) {
+	case -1:
+		return v.y == 0 ? EXIT_LEFT : -1;
+	case 0:
+		switch (v.y) {
+		case -1:
+			return EXIT_UP;
+		case 0:
+			return EXIT_NORMAL;
+		case 1:
+			return EXIT_DOWN;
+		default:
+			return -1;
+		}
+		break;
+	case 1:
+		return v.y == 0 ? EXIT_RIGHT : -1;
+	default:
+		return -1;
+	}
+}
+
 Area::Area(Player* player,
            const std::string& descriptor)
 	: dataArea(DataWorld::instance().area(descriptor)),
 	  player(player),
 	  colorOverlayARGB(0),
+	  chunkDim(0, 0),
+	  flagRowLen(0),
+	  tileDeadline(0),
+	  redrawDeadline(0),
+	  bakeFrame(0),
+	  drawnOffset(0.0, 0.0),
+	  lastCulled(0), totalCulled(0),
+	  lastDirtyFraction(0.0), dirtyFractionSum(0.0),
+	  drawCnt(0),
 	  dim(0, 0, 0),
 	  tileDim(0, 0),
 	  loopX(false), loopY(false),
@@ -70,6 +117,14 @@ Area::Area(Player* player,
 
 Area::~Area()
 {
+	if (drawCnt) {
+		Log::info(descriptor, Formatter(
+			"dirtied % of the screen per frame on average") %
+			meanDirtyFraction());
+		Log::info(descriptor, Formatter(
+			"culled % hidden tiles per frame on average") %
+			((double)totalCulled / (double)drawCnt));
+	}
 }
 
 bool Area::init()
@@ -78,6 +133,219 @@ bool Area::init()
 	return false;
 }
 
+bool Area::build(const AreaDesc& desc)
+{
+	dim = ivec3(desc.dim.x, desc.dim.y, 0);
+	tileDim = desc.tileDim;
+	name = desc.name;
+	musicIntro = desc.musicIntro;
+	musicLoop = desc.musicLoop;
+	musicIntroSet = desc.musicIntroSet;
+	musicLoopSet = desc.musicLoopSet;
+	loopX = desc.loopX;
+	loopY = desc.loopY;
+	colorOverlayARGB = desc.colorOverlayARGB;
+
+	if (dim.x < 0 || dim.y < 0) {
+		Log::err(descriptor, "invalid map size");
+		return false;
+	}
+
+	// Layers are stored in square chunks. Round up so partial chunks
+	// along the right and bottom edges are included.
+	chunkDim.x = (dim.x + AREA_CHUNK_SIZE - 1) / AREA_CHUNK_SIZE;
+	chunkDim.y = (dim.y + AREA_CHUNK_SIZE - 1) / AREA_CHUNK_SIZE;
+
+	// Reserve space for every layer now so the Tile array is never
+	// reallocated.
+	size_t chunkCnt = (size_t)chunkDim.x * (size_t)chunkDim.y;
+	chunks.reserve(desc.layers.size() * chunkCnt);
+	if (!conf.sparseLayers)
+		map.reserve(desc.layers.size() * chunkCnt *
+		            AREA_CHUNK_SIZE * AREA_CHUNK_SIZE);
+
+	// Add TileType #0. Not used, but Tiled's gids start from 1.
+	types.push_back(NULL);
+
+	for (auto& set : desc.tileSets)
+		ASSERT(buildTileSet(set, types));
+
+	for (auto& layer : desc.layers) {
+		allocateMapLayer();
+		if (!addLayerDepth(layer.depth)) {
+			Log::err(descriptor, "depth used multiple times");
+			return false;
+		}
+		ASSERT(buildLayer(layer, dim.z - 1, types));
+	}
+
+	for (auto& obj : desc.objects)
+		ASSERT(buildObject(obj));
+
+	buildFlagPlanes();
+	buildOcclusion();
+
+	return true;
+}
+
+bool Area::buildTileSet(const AreaDesc::TileSetDesc& desc,
+                        std::vector<TileType*>& gids)
+{
+	// Tilesets from TSX files are shared with the other Areas using them.
+	std::shared_ptr<TileTypeSet> set;
+	if (TileSets::shareable(desc))
+		set = TileSets::instance().load(descriptor, desc, tileDim);
+	else {
+		set = TileSets::build(descriptor, desc, tileDim);
+		if (set)
+			for (auto& type : set->types)
+				ownTypes.insert(type.get());
+	}
+	if (!set)
+		return false;
+	typeSets.push_back(set);
+
+	tileSets[desc.imgSource] = TileSet((size_t)desc.width,
+		(size_t)desc.height);
+	TileSet& tileSet = tileSets[desc.imgSource];
+	for (auto& type : set->types) {
+		tileSet.add(type.get());
+		gids.push_back(type.get());
+	}
+
+	// Attach the scripts of the explicitly declared types.
+	for (auto& typeDesc : desc.types) {
+		// "gid" is the global area-wide id of the tile.
+		size_t gid = (size_t)typeDesc.id + (size_t)desc.firstGid;
+		if (gids.size() <= gid) {
+			Log::err(descriptor, "first gid is invalid");
+			return false;
+		}
+
+		TileScripts scripts = {NULL, NULL, NULL};
+		if (typeDesc.enterScript.size())
+			scripts.enter = dataArea->script(typeDesc.enterScript);
+		if (typeDesc.leaveScript.size())
+			scripts.leave = dataArea->script(typeDesc.leaveScript);
+		if (typeDesc.useScript.size())
+			scripts.use = dataArea->script(typeDesc.useScript);
+		if (scripts.enter || scripts.leave || scripts.use)
+			typeScripts[gids[gid]] = scripts;
+	}
+
+	return true;
+}
+
+bool Area::buildLayer(const AreaDesc::LayerDesc& layer, int z,
+                      const std::vector<TileType*>& gids)
+{
+	assert(0 <= z && z < dim.z);
+
+	if ((size_t)dim.x * (size_t)dim.y < layer.gids.size()) {
+		Log::err(descriptor, "layer x,y size != map x,y size");
+		return false;
+	}
+
+	int x = 0, y = 0;
+
+	for (uint32_t gid : layer.gids) {
+		if (gids.size() <= gid) {
+			Log::err(descriptor, "invalid tile gid");
+			return false;
+		}
+
+		// A gid of zero means there is no tile at this position on
+		// this layer.
+		if (gid > 0) {
+			Tile& tile = tileAt(x, y, z);
+			tile.parent = gids[gid];
+		}
+
+		if (++x == dim.x) {
+			x = 0;
+			y++;
+		}
+	}
+
+	return true;
+}
+
+bool Area::buildObject(const AreaDesc::ObjectDesc& obj)
+{
+	int x = obj.x, y = obj.y, w = obj.w, h = obj.h;
+
+	if (obj.z < 0 || dim.z <= obj.z ||
+	    x < 0 || y < 0 || w <= 0 || h <= 0 ||
+	    dim.x < x + w || dim.y < y + h) {
+		Log::err(descriptor, "object out of bounds");
+		return false;
+	}
+
+	DataArea::TileScript enterScript = NULL, leaveScript = NULL,
+		useScript = NULL;
+	if (obj.enterScript.size())
+		enterScript = dataArea->script(obj.enterScript);
+	if (obj.leaveScript.size())
+		leaveScript = dataArea->script(obj.leaveScript);
+	if (obj.useScript.size())
+		useScript = dataArea->script(obj.useScript);
+
+	// Apply the object's properties directly to the Tiles in its
+	// rectangle.
+	for (int Y = y; Y < y + h; Y++) {
+		for (int X = x; X < x + w; X++) {
+			Tile& tile = tileAt(X, Y, obj.z);
+
+			tile.flags |= obj.flags;
+			for (size_t i = 0; i < EXITS_LENGTH; i++) {
+				ExitDirection dir = (ExitDirection)i;
+				if (obj.hasExit[i]) {
+					Exit e = obj.exits[i];
+					if (obj.wwide[i])
+						e.coords.x += X - x;
+					if (obj.hwide[i])
+						e.coords.y += Y - y;
+					setExit(X, Y, obj.z, dir, e);
+				}
+				if (obj.hasLayermod[i])
+					setLayermod(X, Y, obj.z, dir,
+					            obj.layermods[i]);
+			}
+			setTileScripts(X, Y, obj.z, enterScript, leaveScript,
+			               useScript);
+		}
+	}
+
+	return true;
+}
+
+void Area::allocateMapLayer()
+{
+	assert(0 <= dim.z && dim.z + 1 <= std::numeric_limits<int>::max());
+
+	const size_t size = AREA_CHUNK_SIZE;
+	size_t chunkCnt = (size_t)chunkDim.x * (size_t)chunkDim.y;
+
+	// Sparse layers start out empty. Their chunks are allocated as
+	// they are filled in.
+	if (conf.sparseLayers) {
+		chunks.resize(chunks.size() + chunkCnt, NULL);
+		dim.z++;
+		return;
+	}
+
+	// Room for every layer was reserved by build(). Growing past it
+	// would move Tiles that are already pointed to.
+	size_t layerSize = chunkCnt * size * size;
+	assert(map.size() + layerSize <= map.capacity());
+
+	for (size_t i = 0; i < chunkCnt; i++) {
+		chunks.push_back(map.data() + map.size());
+		map.resize(map.size() + size * size);
+	}
+	dim.z++;
+}
+
 void Area::focus()
 {
 	if (!beenFocused) {
@@ -140,48 +408,35 @@ void Area::buttonUp(KeyboardKey key)
 
 void Area::draw()
 {
+	collectDirty();
 	drawTiles();
 	drawEntities();
 	drawColorOverlay();
 	redraw = false;
-}
 
-bool Area::needsRedraw() const
-{
-	if (redraw)
-		return true;
-
-	const icube tiles = visibleTiles();
-	const icube pixels = {
-		tiles.x1 * tileDim.x,
-		tiles.y1 * tileDim.y,
-		tiles.z1,
-		tiles.x2 * tileDim.x,
-		tiles.y2 * tileDim.y,
-		tiles.z2,
+	// Nothing on-screen changes on its own before this.
+	icube pixels = visiblePixels();
+	redrawDeadline = tileDeadline;
+	auto schedule = [&] (const Entity& e) {
+		if (e.onScreen(pixels))
+			redrawDeadline = std::min(redrawDeadline,
+			                          e.nextFrameChange());
 	};
-
-	if (player->needsRedraw(pixels))
-		return true;
+	schedule(*player);
 	for (const auto& character : characters)
-		if (character->needsRedraw(pixels))
-			return true;
+		schedule(*character);
 	for (const auto& overlay : overlays)
-		if (overlay->needsRedraw(pixels))
-			return true;
+		schedule(*overlay);
+}
 
-	// Do any on-screen tile types need to update their animations?
-	for (int z = tiles.z1; z < tiles.z2; z++) {
-		for (int y = tiles.y1; y < tiles.y2; y++) {
-			for (int x = tiles.x1; x < tiles.x2; x++) {
-				const Tile* tile = getTile(x, y, z);
-				const TileType* type = tile->getType();
-				if (type && type->needsRedraw())
-					return true;
-			}
-		}
-	}
-	return false;
+bool Area::needsRedraw() const
+{
+	return redraw || World::instance().time() >= redrawDeadline;
+}
+
+time_t Area::nextRedrawTime() const
+{
+	return redraw ? 0 : redrawDeadline;
 }
 
 void Area::requestRedraw()
@@ -189,6 +444,32 @@ void Area::requestRedraw()
 	redraw = true;
 }
 
+void Area::entityChanged(const Entity& entity)
+{
+	if (redrawDeadline && entity.onScreen(visiblePixels()))
+		redrawDeadline = 0;
+}
+
+const std::vector<icube>& Area::dirtyRegions() const
+{
+	return dirtyRects;
+}
+
+double Area::dirtyFraction() const
+{
+	return lastDirtyFraction;
+}
+
+double Area::meanDirtyFraction() const
+{
+	return drawCnt ? dirtyFractionSum / (double)drawCnt : 0.0;
+}
+
+size_t Area::culledTiles() const
+{
+	return lastCulled;
+}
+
 void Area::tick(time_t dt)
 {
 	if (dataArea)
@@ -254,10 +535,10 @@ const Tile* Area::getTile(int x, int y, int z) const
 		x = wrap(0, x, dim.x);
 	if (loopY)
 		y = wrap(0, y, dim.y);
-	if (inBounds(x, y, z))
-		return &map[(size_t)z][(size_t)y][(size_t)x];
-	else
+	if (!inBounds(x, y, z))
 		return NULL;
+	const Tile* chunk = chunks[chunkIndex(x, y, z)];
+	return chunk ? &chunk[chunkOffset(x, y)] : NULL;
 }
 
 const Tile* Area::getTile(int x, int y, double z) const
@@ -280,47 +561,311 @@ const Tile* Area::getTile(rcoord virt) const
 	return getTile(virt2phys(virt));
 }
 
-Tile* Area::getTile(int x, int y, int z)
+void Area::enterTile(icoord phys)
 {
-	if (loopX)
-		x = wrap(0, x, dim.x);
-	if (loopY)
-		y = wrap(0, y, dim.y);
-	if (inBounds(x, y, z))
-		return &map[(size_t)z][(size_t)y][(size_t)x];
-	else
+	size_t idx;
+	if (tileIndex(phys, &idx))
+		entityCounts[idx]++;
+}
+
+void Area::leaveTile(icoord phys)
+{
+	size_t idx;
+	if (!tileIndex(phys, &idx))
+		return;
+	auto it = entityCounts.find(idx);
+	if (it != entityCounts.end() && --it->second <= 0)
+		entityCounts.erase(it);
+}
+
+bool Area::occupied(icoord phys) const
+{
+	size_t idx;
+	return tileIndex(phys, &idx) && entityCounts.count(idx);
+}
+
+TileSet* Area::getTileSet(const std::string& imagePath)
+{
+	std::map<std::string, TileSet>::iterator it;
+	it = tileSets.find(imagePath);
+	if (it == tileSets.end()) {
+		Log::err("Area", "tileset " + imagePath + " not found");
 		return NULL;
+	}
+	return &tileSets[imagePath];
 }
 
-Tile* Area::getTile(int x, int y, double z)
+const Exit* Area::exitAt(icoord phys, ivec2 dir) const
 {
-	return getTile(x, y, depthIndex(z));
+	size_t idx;
+	int d = ivec2_to_dir(dir);
+	if (d == -1 || !tileIndex(phys, &idx))
+		return NULL;
+	auto it = exits[d].find(idx);
+	return it == exits[d].end() ? NULL : &it->second;
 }
 
-Tile* Area::getTile(icoord phys)
+size_t Area::memoryUsage() const
 {
-	return getTile(phys.x, phys.y, phys.z);
+	size_t bytes = sizeof(*this);
+
+	// Tiles.
+	bytes += map.capacity() * sizeof(Tile);
+	for (auto& chunk : sparseChunks)
+		if (chunk)
+			bytes += AREA_CHUNK_SIZE * AREA_CHUNK_SIZE *
+			         sizeof(Tile);
+	bytes += sparseChunks.capacity() * sizeof(sparseChunks[0]);
+	bytes += chunks.capacity() * sizeof(Tile*);
+
+	// Things derived from the Tiles.
+	for (auto& plane : flagPlanes)
+		bytes += plane.capacity() * sizeof(uint64_t);
+	bytes += topOpaque.capacity() * sizeof(int);
+	for (auto& strip : bakedStrips)
+		bytes += sizeof(strip) + strip.second.draws * BAKED_DRAW_BYTES;
+
+	// Properties of only a few Tiles. Count a hash node as its value and
+	// two pointers.
+	for (size_t i = 0; i < EXITS_LENGTH; i++) {
+		bytes += exits[i].size() *
+		         (sizeof(Exit) + sizeof(size_t) + 2 * sizeof(void*));
+		bytes += layermods[i].size() *
+		         (sizeof(double) + sizeof(size_t) + 2 * sizeof(void*));
+	}
+	bytes += tileScripts.size() *
+	         (sizeof(TileScripts) + sizeof(size_t) + 2 * sizeof(void*));
+
+	// TileTypes and their graphics. Shared tilesets are split evenly
+	// between their users, counting the cache as one.
+	for (auto& set : typeSets)
+		bytes += set->memoryUsage() / (size_t)set.use_count();
+	bytes += typeCopies.size() * sizeof(TileType);
+	bytes += types.capacity() * sizeof(TileType*);
+	bytes += typeScripts.size() * (sizeof(TileScripts) +
+	         sizeof(TileType*) + 2 * sizeof(void*));
+
+	return bytes;
 }
 
-Tile* Area::getTile(vicoord virt)
+void Area::saveState(AreaState* state)
 {
-	return getTile(virt2phys(virt));
+	std::unordered_map<TileType*, uint32_t> gids;
+	for (size_t gid = 1; gid < types.size(); gid++)
+		gids[types[gid]] = (uint32_t)gid;
+
+	for (size_t idx : changedTiles) {
+		int x = (int)(idx % (size_t)dim.x);
+		int y = (int)(idx / (size_t)dim.x % (size_t)dim.y);
+		int z = (int)(idx / (size_t)dim.x / (size_t)dim.y);
+		const Tile& tile = tileAt(x, y, z);
+
+		AreaState::TileChange change;
+		change.idx = idx;
+		change.gid = tile.parent ? gids[tile.getType()] : 0;
+		change.flags = tile.flags;
+		state->tiles.push_back(change);
+	}
+	for (TileType* type : changedTypes)
+		state->typeFlags.push_back(std::make_pair(gids[type],
+		                                          type->flags));
+
+	state->colorOverlayARGB = colorOverlayARGB;
+	state->beenFocused = beenFocused;
+
+	// The Entities live on while we are gone.
+	for (auto& c : characters) {
+		c->setArea(NULL);
+		state->characters.push_back(c);
+	}
+	for (auto& o : overlays) {
+		o->setArea(NULL);
+		state->overlays.push_back(o);
+	}
+	characters.clear();
+	overlays.clear();
 }
 
-Tile* Area::getTile(rcoord virt)
+void Area::restoreState(AreaState& state)
 {
-	return getTile(virt2phys(virt));
+	for (auto& change : state.tiles) {
+		int x = (int)(change.idx % (size_t)dim.x);
+		int y = (int)(change.idx / (size_t)dim.x % (size_t)dim.y);
+		int z = (int)(change.idx / (size_t)dim.x / (size_t)dim.y);
+		if (dim.z <= z || types.size() <= change.gid)
+			continue; // The map file changed under us.
+
+		Tile& tile = tileAt(x, y, z);
+		tile.parent = types[change.gid];
+		tile.flags = change.flags;
+		changedTiles.insert(change.idx);
+		updateOcclusion(x, y);
+	}
+	for (auto& typeFlags : state.typeFlags) {
+		if (typeFlags.first == 0 || types.size() <= typeFlags.first)
+			continue;
+		TileType* type = ownType(types[typeFlags.first]);
+		type->flags = typeFlags.second;
+		changedTypes.insert(type);
+	}
+	buildFlagPlanes();
+
+	colorOverlayARGB = state.colorOverlayARGB;
+	beenFocused = state.beenFocused;
+
+	for (auto& c : state.characters) {
+		c->setArea(this);
+		insert(c);
+	}
+	for (auto& o : state.overlays) {
+		o->setArea(this);
+		insert(o);
+	}
+	redraw = true;
 }
 
-TileSet* Area::getTileSet(const std::string& imagePath)
+std::set<std::string> Area::exitDestinations() const
 {
-	std::map<std::string, TileSet>::iterator it;
-	it = tileSets.find(imagePath);
-	if (it == tileSets.end()) {
-		Log::err("Area", "tileset " + imagePath + " not found");
+	std::set<std::string> dests;
+	for (auto& dirExits : exits)
+		for (auto& exit : dirExits)
+			dests.insert(exit.second.area);
+	return dests;
+}
+
+const double* Area::layermodAt(icoord phys, ivec2 dir) const
+{
+	size_t idx;
+	int d = ivec2_to_dir(dir);
+	if (d == -1 || !tileIndex(phys, &idx))
 		return NULL;
+	auto it = layermods[d].find(idx);
+	return it == layermods[d].end() ? NULL : &it->second;
+}
+
+icoord Area::moveDest(icoord here, ivec2 facing) const
+{
+	icoord dest = here + icoord(facing.x, facing.y, 0);
+
+	const double* layermod = layermodAt(here, facing);
+	if (layermod)
+		dest = virt2phys(vicoord(dest.x, dest.y, *layermod));
+	return dest;
+}
+
+FlagManip Area::flagManip(icoord phys)
+{
+	bool valid = wrapPhys(&phys);
+	assert(valid);
+	(void)valid;
+	Tile& tile = tileAt(phys.x, phys.y, phys.z);
+	return FlagManip(&tile.flags, [this, phys] {
+		changedTiles.insert(tileIndex(phys.x, phys.y, phys.z));
+		updateFlags(phys.x, phys.y, phys.z);
+	});
+}
+
+FlagManip Area::flagManip(TileType* type)
+{
+	type = ownType(type);
+	return FlagManip(&type->flags, [this, type] {
+		changedTypes.insert(type);
+		buildFlagPlanes();
+	});
+}
+
+TileType* Area::ownType(TileType* type)
+{
+	if (ownTypes.count(type))
+		return type;
+
+	TileType* copy = new TileType(*type);
+	typeCopies.push_back(std::unique_ptr<TileType>(copy));
+	ownTypes.insert(copy);
+
+	// Point everything of ours at the copy.
+	for (Tile* chunk : chunks) {
+		if (!chunk)
+			continue;
+		for (size_t i = 0; i < AREA_CHUNK_SIZE * AREA_CHUNK_SIZE; i++)
+			if (chunk[i].parent == type)
+				chunk[i].parent = copy;
 	}
-	return &tileSets[imagePath];
+	for (auto& gid : types)
+		if (gid == type)
+			gid = copy;
+	for (auto& set : tileSets)
+		set.second.replace(type, copy);
+	auto scripts = typeScripts.find(type);
+	if (scripts != typeScripts.end()) {
+		TileScripts moved = scripts->second;
+		typeScripts.erase(scripts);
+		typeScripts[copy] = moved;
+	}
+
+	return copy;
+}
+
+bool Area::hasFlag(icoord phys, unsigned flags) const
+{
+	if (!wrapPhys(&phys))
+		return false;
+	size_t bit = flagBit(phys.x, phys.y, phys.z);
+	for (unsigned i = 0; i < AREA_FLAG_PLANES; i++) {
+		if (!(flags & (1u << i)))
+			continue;
+		if ((flagPlanes[i][bit / 64] >> (bit % 64)) & 1)
+			return true;
+	}
+	return false;
+}
+
+void Area::runEnterScript(icoord phys, Entity* triggeredBy)
+{
+	size_t idx;
+	if (!tileIndex(phys, &idx) || !getTile(phys))
+		return;
+	// The Tile exists, so this doesn't allocate.
+	wrapPhys(&phys);
+	Tile* tile = &tileAt(phys.x, phys.y, phys.z);
+	auto it = tileScripts.find(idx);
+	if (it != tileScripts.end() && it->second.enter)
+		(dataArea->*it->second.enter)(*triggeredBy, *tile);
+	auto type = typeScripts.find(tile->getType());
+	if (type != typeScripts.end() && type->second.enter)
+		(dataArea->*type->second.enter)(*triggeredBy, *tile);
+}
+
+void Area::runLeaveScript(icoord phys, Entity* triggeredBy)
+{
+	size_t idx;
+	if (!tileIndex(phys, &idx) || !getTile(phys))
+		return;
+	// The Tile exists, so this doesn't allocate.
+	wrapPhys(&phys);
+	Tile* tile = &tileAt(phys.x, phys.y, phys.z);
+	auto it = tileScripts.find(idx);
+	if (it != tileScripts.end() && it->second.leave)
+		(dataArea->*it->second.leave)(*triggeredBy, *tile);
+	auto type = typeScripts.find(tile->getType());
+	if (type != typeScripts.end() && type->second.leave)
+		(dataArea->*type->second.leave)(*triggeredBy, *tile);
+}
+
+void Area::runUseScript(icoord phys, Entity* triggeredBy)
+{
+	size_t idx;
+	if (!tileIndex(phys, &idx) || !getTile(phys))
+		return;
+	// The Tile exists, so this doesn't allocate.
+	wrapPhys(&phys);
+	Tile* tile = &tileAt(phys.x, phys.y, phys.z);
+	auto it = tileScripts.find(idx);
+	if (it != tileScripts.end() && it->second.use)
+		(dataArea->*it->second.use)(*triggeredBy, *tile);
+	auto type = typeScripts.find(tile->getType());
+	if (type != typeScripts.end() && type->second.use)
+		(dataArea->*type->second.use)(*triggeredBy, *tile);
 }
 
 
@@ -352,6 +897,19 @@ icube Area::visibleTileBounds() const
 	return icube(x1, y1, 0, x2, y2, dim.z);
 }
 
+icube Area::visiblePixels() const
+{
+	const icube tiles = visibleTiles();
+	return icube(
+		tiles.x1 * tileDim.x,
+		tiles.y1 * tileDim.y,
+		tiles.z1,
+		tiles.x2 * tileDim.x,
+		tiles.y2 * tileDim.y,
+		tiles.z2
+	);
+}
+
 icube Area::visibleTiles() const
 {
 	icube cube = visibleTileBounds();
@@ -507,13 +1065,12 @@ DataArea* Area::getDataArea()
 
 int Area::depthIndex(double depth) const
 {
-	std::map<double, int>::const_iterator it;
-	it = depth2idx.find(depth);
-	if (it == depth2idx.end()) {
+	int idx = findDepthIndex(depth);
+	if (idx == -1) {
 		Log::fatal(descriptor, Formatter(
 			"attempt to access invalid layer: %") % depth);
 	}
-	return it->second;
+	return idx;
 }
 
 double Area::indexDepth(int idx) const
@@ -522,22 +1079,410 @@ double Area::indexDepth(int idx) const
 	return idx2depth[(size_t)idx];
 }
 
+int Area::findDepthIndex(double depth) const
+{
+	auto it = std::lower_bound(depth2idx.begin(), depth2idx.end(),
+	                           std::make_pair(depth, INT_MIN));
+	if (it == depth2idx.end() || it->first != depth)
+		return -1;
+	return it->second;
+}
+
+bool Area::addLayerDepth(double depth)
+{
+	auto entry = std::make_pair(depth, INT_MIN);
+	auto it = std::lower_bound(depth2idx.begin(), depth2idx.end(), entry);
+	if (it != depth2idx.end() && it->first == depth)
+		return false;
+
+	entry.second = dim.z - 1;
+	depth2idx.insert(it, entry);
+	idx2depth.push_back(depth);
+	// Effectively idx2depth[dim.z - 1] = depth;
+	return true;
+}
+
+size_t Area::chunkIndex(int x, int y, int z) const
+{
+	assert(0 <= x && x < dim.x);
+	assert(0 <= y && y < dim.y);
+	assert(0 <= z && z < dim.z);
+	int cx = x / AREA_CHUNK_SIZE;
+	int cy = y / AREA_CHUNK_SIZE;
+	return ((size_t)z * (size_t)chunkDim.y + (size_t)cy) *
+		(size_t)chunkDim.x + (size_t)cx;
+}
+
+size_t Area::chunkOffset(int x, int y) const
+{
+	return (size_t)(y % AREA_CHUNK_SIZE) * AREA_CHUNK_SIZE +
+		(size_t)(x % AREA_CHUNK_SIZE);
+}
+
+int Area::rowRun(int x, int wx, int x2) const
+{
+	int run = AREA_CHUNK_SIZE - wx % AREA_CHUNK_SIZE;
+	run = std::min(run, dim.x - wx);
+	return std::min(run, x2 - x);
+}
+
+size_t Area::tileIndex(int x, int y, int z) const
+{
+	assert(0 <= x && x < dim.x);
+	assert(0 <= y && y < dim.y);
+	assert(0 <= z && z < dim.z);
+	return ((size_t)z * (size_t)dim.y + (size_t)y) * (size_t)dim.x +
+		(size_t)x;
+}
+
+bool Area::tileIndex(icoord phys, size_t* idx) const
+{
+	if (!wrapPhys(&phys))
+		return false;
+	*idx = tileIndex(phys.x, phys.y, phys.z);
+	return true;
+}
+
+bool Area::wrapPhys(icoord* phys) const
+{
+	if (loopX)
+		phys->x = wrap(0, phys->x, dim.x);
+	if (loopY)
+		phys->y = wrap(0, phys->y, dim.y);
+	return inBounds(*phys);
+}
+
+size_t Area::flagBit(int x, int y, int z) const
+{
+	assert(0 <= x && x < dim.x);
+	assert(0 <= y && y < dim.y);
+	assert(0 <= z && z < dim.z);
+	return ((size_t)z * (size_t)dim.y + (size_t)y) * flagRowLen * 64 +
+		(size_t)x;
+}
+
+//! Flags of a Tile combined with those of its type.
+static unsigned effectiveFlags(const Tile* tile)
+{
+	unsigned flags = 0;
+	for (const TileBase* base = tile; base; base = base->getType())
+		flags |= base->getFlags();
+	return flags;
+}
+
+void Area::updateFlags(int x, int y, int z)
+{
+	const Tile* chunk = chunks[chunkIndex(x, y, z)];
+	unsigned flags = chunk ? effectiveFlags(&chunk[chunkOffset(x, y)]) : 0;
+
+	size_t bit = flagBit(x, y, z);
+	uint64_t mask = (uint64_t)1 << (bit % 64);
+	for (unsigned i = 0; i < AREA_FLAG_PLANES; i++) {
+		uint64_t& word = flagPlanes[i][bit / 64];
+		if (flags & (1u << i))
+			word |= mask;
+		else
+			word &= ~mask;
+	}
+}
+
+void Area::updateOcclusion(int x, int y)
+{
+	int top = -1;
+	for (int z = 0; z < dim.z; z++) {
+		const Tile* chunk = chunks[chunkIndex(x, y, z)];
+		if (!chunk)
+			continue;
+		const TileType* type = chunk[chunkOffset(x, y)].getType();
+		if (!type || !type->anim.isOpaque())
+			continue;
+		if (top == -1 || idx2depth[(size_t)z] > idx2depth[(size_t)top])
+			top = z;
+	}
+	topOpaque[(size_t)y * (size_t)dim.x + (size_t)x] = top;
+}
+
+void Area::buildOcclusion()
+{
+	topOpaque.assign((size_t)dim.x * (size_t)dim.y, -1);
+	for (int y = 0; y < dim.y; y++)
+		for (int x = 0; x < dim.x; x++)
+			updateOcclusion(x, y);
+}
+
+bool Area::occluded(int x, int y, int z) const
+{
+	int top = topOpaque[(size_t)y * (size_t)dim.x + (size_t)x];
+	return top != -1 && idx2depth[(size_t)z] < idx2depth[(size_t)top];
+}
+
+TileType* Area::visibleType(const Tile& tile, int x, int y, int z) const
+{
+	TileType* type = tile.getType();
+	if (type && occluded(x, y, z))
+		return NULL;
+	return type;
+}
+
+void Area::buildFlagPlanes()
+{
+	flagRowLen = ((size_t)dim.x + 63) / 64;
+	size_t words = (size_t)dim.z * (size_t)dim.y * flagRowLen;
+	for (auto& plane : flagPlanes)
+		plane.assign(words, 0);
+
+	for (int z = 0; z < dim.z; z++)
+		for (int y = 0; y < dim.y; y++)
+			for (int x = 0; x < dim.x; x++)
+				updateFlags(x, y, z);
+}
+
+void Area::setExit(int x, int y, int z, ExitDirection dir,
+                   const Exit& exit)
+{
+	exits[dir][tileIndex(x, y, z)] = exit;
+}
 
+void Area::setLayermod(int x, int y, int z, ExitDirection dir, double mod)
+{
+	layermods[dir][tileIndex(x, y, z)] = mod;
+}
+
+void Area::setTileScripts(int x, int y, int z, DataArea::TileScript enter,
+                          DataArea::TileScript leave,
+                          DataArea::TileScript use)
+{
+	if (!enter && !leave && !use)
+		return;
+	TileScripts& scripts = tileScripts[tileIndex(x, y, z)];
+	scripts.enter = enter;
+	scripts.leave = leave;
+	scripts.use = use;
+}
+
+Tile& Area::tileAt(int x, int y, int z)
+{
+	Tile*& chunk = chunks[chunkIndex(x, y, z)];
+	if (!chunk)
+		chunk = allocateChunk();
+	return chunk[chunkOffset(x, y)];
+}
+
+Tile* Area::allocateChunk()
+{
+	Tile* chunk = new Tile[AREA_CHUNK_SIZE * AREA_CHUNK_SIZE];
+	sparseChunks.emplace_back(chunk);
+	return chunk;
+}
+
+
+
+void Area::collectDirty()
+{
+	time_t now = World::instance().time();
+	icube visible = visibleTiles();
+	rvec2 offset = Viewport::instance().getMapOffset();
+
+	dirtyRects.clear();
+
+	if (redraw || offset != drawnOffset) {
+		// Everything on-screen changed.
+		dirtyRects.push_back(visible);
+	}
+	else {
+		for (const auto& region : animatedRegions)
+			if (now >= region.second.deadline)
+				dirtyRects.push_back(region.second.tiles);
+
+		auto addEntity = [&] (const Entity& e) {
+			if (e.isDirty(now)) {
+				dirtyRects.push_back(pixelsToTiles(
+					e.drawnPixels()));
+				dirtyRects.push_back(pixelsToTiles(e.pixels()));
+			}
+		};
+		addEntity(*player);
+		for (const auto& character : characters)
+			addEntity(*character);
+		for (const auto& overlay : overlays)
+			addEntity(*overlay);
+	}
+	drawnOffset = offset;
+
+	// Count the visible Tiles covered by at least one dirty region.
+	int w = visible.x2 - visible.x1;
+	int h = visible.y2 - visible.y1;
+	if (w <= 0 || h <= 0)
+		return;
+	dirtyTiles.assign((size_t)(w * h), false);
+	size_t coveredCnt = 0;
+	for (const icube& rect : dirtyRects) {
+		int x1 = std::max(rect.x1, visible.x1) - visible.x1;
+		int y1 = std::max(rect.y1, visible.y1) - visible.y1;
+		int x2 = std::min(rect.x2, visible.x2) - visible.x1;
+		int y2 = std::min(rect.y2, visible.y2) - visible.y1;
+		for (int y = y1; y < y2; y++) {
+			for (int x = x1; x < x2; x++) {
+				size_t i = (size_t)(y * w + x);
+				if (!dirtyTiles[i]) {
+					dirtyTiles[i] = true;
+					coveredCnt++;
+				}
+			}
+		}
+	}
+
+	lastDirtyFraction = (double)coveredCnt / (double)(w * h);
+	dirtyFractionSum += lastDirtyFraction;
+	drawCnt++;
+}
+
+icube Area::pixelsToTiles(const icube& pixels) const
+{
+	return icube(
+		(int)floor((double)pixels.x1 / tileDim.x),
+		(int)floor((double)pixels.y1 / tileDim.y),
+		0,
+		(int)ceil((double)pixels.x2 / tileDim.x),
+		(int)ceil((double)pixels.y2 / tileDim.y),
+		dim.z
+	);
+}
 
 void Area::drawTiles()
 {
+	tileDeadline = ANIM_NO_FRAME_CHANGE;
+	animatedRegions.clear();
+	lastCulled = 0;
+
 	icube tiles = visibleTiles();
 	for (int z = tiles.z1; z < tiles.z2; z++) {
 		assert(0 <= z && z <= dim.z);
 		double depth = idx2depth[(size_t)z];
 		for (int y = tiles.y1; y < tiles.y2; y++) {
-			for (int x = tiles.x1; x < tiles.x2; x++) {
-				Tile* tile = getTile(x, y, z);
-				// We are certain the Tile exists.
-				drawTile(*tile, x, y, depth);
+			// Walk each row a chunk at a time instead of going
+			// through getTile(). Chunks that were never allocated
+			// are empty and are skipped whole.
+			int wy = loopY ? wrap(0, y, dim.y) : y;
+			for (int x = tiles.x1; x < tiles.x2; ) {
+				int wx = loopX ? wrap(0, x, dim.x) : x;
+				int run = rowRun(x, wx, tiles.x2);
+				Tile* chunk = chunks[chunkIndex(wx, wy, z)];
+				if (chunk)
+					drawRun(chunk, wx, wy, z, x, y, depth,
+					        run);
+				x += run;
 			}
 		}
 	}
+	totalCulled += lastCulled;
+
+	// Sweep now and then rather than every frame. At most twice the
+	// maximum age's worth of strips are kept.
+	if (++bakeFrame % BAKED_STRIP_MAX_AGE == 0)
+		evictStrips();
+}
+
+void Area::evictStrips()
+{
+	for (auto it = bakedStrips.begin(); it != bakedStrips.end(); ) {
+		if (bakeFrame - it->second.drawnAt > BAKED_STRIP_MAX_AGE)
+			it = bakedStrips.erase(it);
+		else
+			++it;
+	}
+}
+
+//! Can a Tile be drawn ahead of time?
+static bool isStatic(const TileType* type)
+{
+	return type && type->anim.isStatic();
+}
+
+void Area::drawRun(Tile* chunk, int wx, int wy, int z, int x, int y,
+                   double depth, int run)
+{
+	// The row of the chunk that this run falls in. The run may not cover
+	// all of it if it is at the edge of the screen.
+	int sx = wx - wx % AREA_CHUNK_SIZE;
+	int len = std::min(AREA_CHUNK_SIZE, dim.x - sx);
+	Tile* row = &chunk[chunkOffset(sx, wy)];
+	size_t key = chunkIndex(wx, wy, z) * AREA_CHUNK_SIZE +
+		(size_t)(wy % AREA_CHUNK_SIZE);
+
+	const BakedStrip* strip = bakeStrip(key, row, sx, wy, z, len);
+	if (strip && strip->img) {
+		rvec2 drawPos(
+			double((x - (wx - sx)) * tileDim.x),
+			double(y * tileDim.y)
+		);
+		strip->img->draw(drawPos.x, drawPos.y,
+		                 depth + isometricZOff(drawPos));
+	}
+
+	for (int i = 0; i < run; i++) {
+		Tile& tile = row[wx - sx + i];
+		TileType* type = visibleType(tile, wx + i, wy, z);
+		if (!type) {
+			if (tile.getType())
+				lastCulled++;
+			continue;
+		}
+		if (!strip || !strip->statics[wx - sx + i])
+			drawTile(tile, x + i, y, depth);
+	}
+}
+
+Area::BakedStrip::BakedStrip()
+	: draws(0), drawnAt(0), baked(false)
+{
+}
+
+const Area::BakedStrip* Area::bakeStrip(size_t key, const Tile* row,
+                                        int sx, int wy, int z, int len)
+{
+	BakedStrip& strip = bakedStrips[key];
+	strip.drawnAt = bakeFrame;
+
+	bool valid = strip.baked;
+	for (int i = 0; valid && i < len; i++) {
+		TileType* type = visibleType(row[i], sx + i, wy, z);
+		valid = strip.types[i] == type &&
+		        strip.statics[i] == isStatic(type);
+	}
+	if (valid)
+		return &strip;
+
+	bool anyStatic = false;
+	for (int i = 0; i < len; i++) {
+		strip.types[i] = visibleType(row[i], sx + i, wy, z);
+		strip.statics[i] = isStatic(strip.types[i]);
+		anyStatic = anyStatic || strip.statics[i];
+	}
+	strip.img.reset();
+	strip.draws = 0;
+	strip.baked = true;
+	if (!anyStatic)
+		return &strip;
+
+	Images& images = Images::instance();
+	if (!images.beginRecording()) {
+		bakedStrips.erase(key);
+		return NULL;
+	}
+	time_t now = World::instance().time();
+	for (int i = 0; i < len; i++) {
+		if (!strip.statics[i])
+			continue;
+		Image* img = strip.types[i]->anim.frame(now);
+		if (img && img->opacity() != OPACITY_TRANSPARENT) {
+			img->draw(double(i * tileDim.x), 0.0, 0.0);
+			strip.draws++;
+		}
+	}
+	strip.img = images.endRecording((unsigned)(len * tileDim.x),
+	                                (unsigned)tileDim.y);
+	return &strip;
 }
 
 void Area::drawTile(Tile& tile, int x, int y, double depth)
@@ -546,6 +1491,27 @@ void Area::drawTile(Tile& tile, int x, int y, double depth)
 	if (type) {
 		time_t now = World::instance().time();
 		Image* img = type->anim.frame(now);
+		time_t deadline = type->anim.nextFrameChange(now);
+		if (deadline != ANIM_NO_FRAME_CHANGE) {
+			tileDeadline = std::min(tileDeadline, deadline);
+
+			// Remember where this type is on-screen so that only
+			// those Tiles are dirtied when it changes frames.
+			auto it = animatedRegions.find(type);
+			if (it == animatedRegions.end()) {
+				AnimatedRegion region = {
+					deadline, icube(x, y, 0, x + 1, y + 1, dim.z)
+				};
+				animatedRegions.emplace(type, region);
+			}
+			else {
+				icube& tiles = it->second.tiles;
+				tiles.x1 = std::min(tiles.x1, x);
+				tiles.y1 = std::min(tiles.y1, y);
+				tiles.x2 = std::max(tiles.x2, x + 1);
+				tiles.y2 = std::max(tiles.y2, y + 1);
+			}
+		}
 		if (img) {
 			rvec2 drawPos(
 				double(x * (int)img->width()),
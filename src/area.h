@@ -31,9 +31,13 @@
 #include <memory>
 #include <set>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
+#include "area-desc.h"
 #include "entity.h"
+#include "images.h"
 #include "tile.h"
 #include "vec.h"
 #include "window.h"
@@ -42,10 +46,44 @@
 
 #define ISOMETRIC_ZOFF_PER_TILE 0.001
 
+//! Width and height in Tiles of the square chunks each layer of an Area is
+//! divided into.
+#define AREA_CHUNK_SIZE 16
+
+//! Number of low flag bits, TILE_NOWALK and up, that an Area keeps a bitmap
+//! of. See Area::hasFlag().
+#define AREA_FLAG_PLANES 5
+
 class Character;
 class NPC;
 class Overlay;
 class Player;
+struct TileTypeSet;
+
+//! What an Area would lose by being unloaded and loaded again from its map
+//! file: changes made to it since it was built, and its Entities. See
+//! Area::saveState().
+struct AreaState
+{
+	struct TileChange {
+		size_t idx;      //!< See Area::tileIndex().
+		uint32_t gid;    //!< Type of the Tile. 0 if it has none.
+		unsigned flags;
+	};
+
+	std::vector<TileChange> tiles;
+
+	//! Flags of changed TileTypes, by gid.
+	std::vector<std::pair<uint32_t, unsigned>> typeFlags;
+
+	uint32_t colorOverlayARGB;
+	bool beenFocused;
+
+	//! The Entities themselves are kept, detached from any Area, so
+	//! that scripts holding on to them aren't left with stale copies.
+	std::vector<std::shared_ptr<Character>> characters;
+	std::vector<std::shared_ptr<Overlay>> overlays;
+};
 
 //! An Area represents one map, or screen, in a World.
 /*!
@@ -79,11 +117,39 @@ public:
 	void draw();
 
 	//! If false, drawing might be skipped. Saves CPU cycles when idle.
+	//! Only compares the time against nextRedrawTime().
 	bool needsRedraw() const;
 
+	//! Earliest time at which something on-screen will change on its own,
+	//! as of the last draw(). Covers animated Tiles and the frames of
+	//! on-screen Entities. Returns 0 if a redraw is already due.
+	time_t nextRedrawTime() const;
+
 	//! Inform the Area that a redraw is needed.
 	void requestRedraw();
 
+	//! Inform the Area that an Entity moved or changed how it looks. A
+	//! redraw is needed only if the Entity is or was on-screen.
+	void entityChanged(const Entity& entity);
+
+	//! Regions of the screen, in Tile coordinates, that changed since
+	//! the draw() before the last one: moved Entities, Tiles whose
+	//! animation changed frame, and the whole screen after scrolling or
+	//! requestRedraw(). These are what the last draw() actually needed
+	//! to repaint. The Gosu backend clears the screen every frame and so
+	//! still repaints all of it; for now the regions only feed
+	//! dirtyFraction().
+	const std::vector<icube>& dirtyRegions() const;
+
+	//! Fraction of the visible Tiles that were dirty in the last draw(),
+	//! and the mean of that over every draw().
+	double dirtyFraction() const;
+	double meanDirtyFraction() const;
+
+	//! Number of Tiles skipped in the last draw() because an opaque Tile
+	//! on a higher layer hid them.
+	size_t culledTiles() const;
+
 	/**
 	 * Update the game state within this Area as if dt milliseconds had
 	 * passed since the last call. Updates Entities, runs scripts, and
@@ -99,19 +165,74 @@ public:
 
 	void setColorOverlay(uint8_t a, uint8_t r, uint8_t g, uint8_t b);
 
+	//! Returns NULL for Tiles out of bounds, and for Tiles in chunks of a
+	//! sparse layer that were never allocated. Such Tiles are empty.
+	//! Looking never allocates; only building the Area and changing its
+	//! Tiles do.
 	const Tile* getTile(int x, int y, int z) const; /* phys */
 	const Tile* getTile(int x, int y, double z) const; /* virt */
 	const Tile* getTile(icoord phys) const;
 	const Tile* getTile(vicoord virt) const;
 	const Tile* getTile(rcoord virt) const;
-	Tile* getTile(int x, int y, int z); /* phys */
-	Tile* getTile(int x, int y, double z); /* virt */
-	Tile* getTile(icoord phys);
-	Tile* getTile(vicoord virt);
-	Tile* getTile(rcoord virt);
+
+	//! Count the Entities standing on a Tile, so others can't walk onto
+	//! it. Tiles out of bounds are ignored. Kept apart from the Tiles so
+	//! walking over empty parts of a sparse layer doesn't allocate them.
+	void enterTile(icoord phys);
+	void leaveTile(icoord phys);
+	bool occupied(icoord phys) const;
 
 	TileSet* getTileSet(const std::string& imagePath);
 
+	//! Exit or layermod taken when leaving the Tile at a physical
+	//! coordinate in direction dir. A zero dir refers to the one taken
+	//! upon arriving at the Tile. NULL if there is none.
+	const Exit* exitAt(icoord phys, ivec2 dir) const;
+	const double* layermodAt(icoord phys, ivec2 dir) const;
+
+	//! Approximate number of bytes of memory held by this Area.
+	size_t memoryUsage() const;
+
+	//! Save what would be lost by unloading this Area, moving its
+	//! Entities out of it. The Area must not be used afterwards.
+	void saveState(AreaState* state);
+
+	//! Apply state saved from an earlier instance of this Area. Call
+	//! after init().
+	void restoreState(AreaState& state);
+
+	//! Descriptors of the Areas that this Area's exits lead to.
+	std::set<std::string> exitDestinations() const;
+
+	/**
+	 * Gets the correct destination for an Entity wanting to
+	 * move off of the Tile at <code>here</code> in
+	 * <code>facing</code> direction.
+	 *
+	 * This call is necessary to handle layermod.
+	 *
+	 * @param here    physical coordinate of the Tile
+	 * @param facing  facing vector
+	 */
+	icoord moveDest(icoord here, ivec2 facing) const;
+
+	//! Manipulate the flags of the Tile at an in-bounds physical
+	//! coordinate, or those of a TileType. This is the only way to change
+	//! flags, so that hasFlag() stays up to date. Changes to a TileType
+	//! rebuild the flags of the whole Area.
+	FlagManip flagManip(icoord phys);
+	FlagManip flagManip(TileType* type);
+
+	//! Returns true if the Tile at a physical coordinate or its type has
+	//! any of the flags. Tiles out of bounds have no flags.
+	bool hasFlag(icoord phys, unsigned flags) const;
+
+	//! Run the scripts attached to the Tile at a physical coordinate and
+	//! to its type.
+	void runEnterScript(icoord phys, Entity* triggeredBy);
+	void runLeaveScript(icoord phys, Entity* triggeredBy);
+	void runUseScript(icoord phys, Entity* triggeredBy);
+
 	//! Return the dimensions of the Tile matrix.
 	ivec3 getDimensions() const;
 	//! Return the pixel dimensions of a Tile graphic.
@@ -124,6 +245,8 @@ public:
 	//! Returns a physical cubic range of Tiles that are visible on-screen.
 	//! Takes actual map size into account.
 	icube visibleTiles() const;
+	//! The pixels covered by visibleTiles(). Only x and y are used.
+	icube visiblePixels() const;
 
 	//! Returns true if a Tile exists at the specified coordinate.
 	bool inBounds(int x, int y, int z) const; /* phys */
@@ -166,12 +289,106 @@ public:
 
 
 protected:
+	//! Populate this Area from a description of its map file. Loads
+	//! tileset images and looks up scripts.
+	bool build(const AreaDesc& desc);
+	bool buildTileSet(const AreaDesc::TileSetDesc& desc,
+	                  std::vector<TileType*>& gids);
+	bool buildLayer(const AreaDesc::LayerDesc& layer, int z,
+	                const std::vector<TileType*>& gids);
+	bool buildObject(const AreaDesc::ObjectDesc& obj);
+
+	//! Allocate Tile objects for one layer of map.
+	void allocateMapLayer();
+
 	// Convert between virtual and physical map depths.
 	int depthIndex(double depth) const;
 	double indexDepth(int idx) const;
 
+	//! Index of the layer at a virtual depth, or -1 if there is none.
+	int findDepthIndex(double depth) const;
+
+	//! Assign a virtual depth to the most recently allocated layer.
+	//! Returns false if the depth is already in use.
+	bool addLayerDepth(double depth);
+
+	//! Position in our chunk directory of the chunk holding a Tile, and
+	//! position of the Tile within its chunk. The coordinate must already
+	//! be wrapped and in bounds.
+	size_t chunkIndex(int x, int y, int z) const;
+	size_t chunkOffset(int x, int y) const;
+
+	//! Number of Tiles that can be walked in a row starting at x (wrapped
+	//! to wx) without leaving the chunk, the map, or stopping at x2.
+	int rowRun(int x, int wx, int x2) const;
+
+	//! Key of a Tile in our side tables. Unlike chunkIndex(), this is the
+	//! same whether or not the layer is sparse. The coordinate must
+	//! already be wrapped and in bounds.
+	size_t tileIndex(int x, int y, int z) const;
+
+	//! Wrap a physical coordinate in looping dimensions and find its key
+	//! in our side tables. Returns false if it is out of bounds.
+	bool tileIndex(icoord phys, size_t* idx) const;
+
+	//! Wrap a physical coordinate in looping dimensions. Returns false if
+	//! it is out of bounds.
+	bool wrapPhys(icoord* phys) const;
+
+	//! Position of a Tile's bit in our flag bitmaps. The coordinate must
+	//! already be wrapped and in bounds.
+	size_t flagBit(int x, int y, int z) const;
+
+	//! Recompute the flag bits of one Tile, or of every Tile.
+	void updateFlags(int x, int y, int z);
+	void buildFlagPlanes();
+
+	//! Get a TileType that only this Area uses in place of type. A type
+	//! shared with other Areas is copied, and our Tiles are switched over
+	//! to the copy.
+	TileType* ownType(TileType* type);
+
+	//! Recompute the topmost opaque layer of one cell, or of every cell.
+	//! The coordinate must already be wrapped and in bounds.
+	void updateOcclusion(int x, int y);
+	void buildOcclusion();
+
+	//! Is the Tile at a wrapped, in-bounds coordinate hidden beneath an
+	//! opaque Tile?
+	bool occluded(int x, int y, int z) const;
+
+	//! Type of a Tile as it should be drawn. NULL if it is hidden.
+	TileType* visibleType(const Tile& tile, int x, int y, int z) const;
+
+	//! Attach properties that only a few Tiles have. The coordinate must
+	//! already be wrapped and in bounds.
+	void setExit(int x, int y, int z, ExitDirection dir, const Exit& exit);
+	void setLayermod(int x, int y, int z, ExitDirection dir, double mod);
+	void setTileScripts(int x, int y, int z, DataArea::TileScript enter,
+	                    DataArea::TileScript leave,
+	                    DataArea::TileScript use);
+
+	//! Fetch the Tile at a wrapped, in-bounds physical coordinate,
+	//! allocating its chunk if it doesn't exist yet.
+	Tile& tileAt(int x, int y, int z);
+
+	//! Allocate the Tiles for one chunk of a sparse layer.
+	Tile* allocateChunk();
+
+	//! Gather everything that changed since the last draw() into
+	//! dirtyRects and update our redraw counters.
+	void collectDirty();
+
+	//! Convert a rectangle of pixels into the Tiles it touches.
+	icube pixelsToTiles(const icube& pixels) const;
+
 	//! Calculate frame to show for each type of tile
 	void drawTiles();
+
+	//! Draw a run of Tiles from one row of a chunk. Static Tiles are drawn
+	//! with a single baked image for the whole row of the chunk.
+	void drawRun(Tile* chunk, int wx, int wy, int z, int x, int y,
+	             double depth, int run);
 	void drawTile(Tile& tile, int x, int y, double depth);
 	void drawEntities();
 	void drawColorOverlay();
@@ -187,12 +404,120 @@ protected:
 	typedef std::set<std::shared_ptr<Overlay>> OverlaySet;
 	OverlaySet overlays;
 
-	typedef std::vector<Tile> row_t;
-	typedef std::vector<row_t> grid_t;
-	typedef std::vector<grid_t> tilematrix_t;
-
-	//! 3-dimensional array of the tiles that make up the map.
-	tilematrix_t map;
+	//! The Tiles of fully allocated layers, stored contiguously. Layers
+	//! follow one another, and each layer is laid out chunk by chunk.
+	//!
+	//! Tiles are referred to by pointer elsewhere in the engine, so this
+	//! must not be reallocated once populated.
+	std::vector<Tile> map;
+
+	//! The Tiles of sparse layers, one allocation per chunk. A chunk is
+	//! only allocated once something is placed in it.
+	std::vector<std::unique_ptr<Tile[]>> sparseChunks;
+
+	//! First Tile of every chunk of every layer, indexed by chunkIndex().
+	//! NULL for chunks of sparse layers that hold nothing.
+	std::vector<Tile*> chunks;
+
+	//! Number of chunks across and down each layer.
+	ivec2 chunkDim;
+
+	//! Scripts attached to a single Tile by an object in the map, or to a
+	//! TileType.
+	struct TileScripts {
+		DataArea::TileScript enter, leave, use;
+	};
+
+	//! Flags of every Tile combined with those of its type. One bitmap
+	//! per flag bit, each laid out layer by layer and row by row, with
+	//! rows padded to whole words. See flagBit().
+	std::vector<uint64_t> flagPlanes[AREA_FLAG_PLANES];
+	size_t flagRowLen;
+
+	//! Earliest time at which a Tile animation drawn in the last draw()
+	//! will change frames.
+	time_t tileDeadline;
+
+	//! The earlier of tileDeadline and the next frame change of any
+	//! on-screen Entity, or 0 if an Entity has changed since the last
+	//! draw(). See nextRedrawTime().
+	time_t redrawDeadline;
+
+	//! Screen Tiles covered by each animated TileType in the last draw(),
+	//! and when that TileType next changes frames.
+	struct AnimatedRegion {
+		time_t deadline;
+		icube tiles;
+	};
+	std::unordered_map<const TileType*, AnimatedRegion> animatedRegions;
+
+	//! A row of one chunk with its static Tiles drawn ahead of time into
+	//! one Image. Keyed by chunkIndex() * AREA_CHUNK_SIZE + row.
+	struct BakedStrip {
+		BakedStrip();
+
+		//! NULL if the strip has no static Tiles, or if the backend
+		//! cannot bake.
+		std::shared_ptr<Image> img;
+
+		//! Types of the Tiles when baked, NULL if hidden, and
+		//! whether each was static and so drawn into img. If any
+		//! changes, we rebake. A finite animation becomes static
+		//! when its cycles run out.
+		TileType* types[AREA_CHUNK_SIZE];
+		bool statics[AREA_CHUNK_SIZE];
+
+		//! Number of Images drawn into img.
+		unsigned draws;
+
+		//! Value of bakeFrame when this strip was last drawn.
+		size_t drawnAt;
+		bool baked;
+	};
+	std::unordered_map<size_t, BakedStrip> bakedStrips;
+
+	//! Count of drawTiles() calls. See evictStrips().
+	size_t bakeFrame;
+
+	//! Forget the baked strips not drawn in the last BAKED_STRIP_MAX_AGE
+	//! frames, so that bakedStrips only holds what is on-screen and where
+	//! the screen has just been.
+	void evictStrips();
+
+	//! Find the baked strip for a row of a chunk, baking it if needed.
+	//! Returns NULL if the backend cannot bake.
+	const BakedStrip* bakeStrip(size_t key, const Tile* row, int sx,
+	                            int wy, int z, int len);
+
+	//! Dirty regions in Tile coordinates. See dirtyRegions().
+	std::vector<icube> dirtyRects;
+
+	//! Map offset at the last draw(). Scrolling dirties the whole screen.
+	rvec2 drawnOffset;
+
+	//! For each x,y cell, the layer of the opaque Tile with the greatest
+	//! depth, or -1 if there is none. Row by row.
+	std::vector<int> topOpaque;
+
+	//! Occlusion counters. See culledTiles().
+	size_t lastCulled, totalCulled;
+
+	//! Redraw counters. See dirtyFraction().
+	double lastDirtyFraction, dirtyFractionSum;
+	size_t drawCnt;
+
+	//! Which visible Tiles collectDirty() found dirty. Kept between
+	//! draws so it isn't allocated every frame.
+	std::vector<bool> dirtyTiles;
+
+	//! Properties that only a few Tiles have, keyed by tileIndex(). One
+	//! table of exits and layermods per ExitDirection.
+	std::unordered_map<size_t, Exit> exits[EXITS_LENGTH];
+	std::unordered_map<size_t, double> layermods[EXITS_LENGTH];
+	std::unordered_map<size_t, TileScripts> tileScripts;
+
+	//! Entities standing on each Tile, by tileIndex(). See enterTile().
+	std::unordered_map<size_t, int> entityCounts;
 
 	//! 3-dimensional length of map.
 	ivec3 dim;
@@ -204,8 +529,32 @@ protected:
 	typedef std::map<std::string, TileSet> tilesets_t;
 	tilesets_t tileSets;
 
+	//! Every TileType, by gid. gid 0 is NULL.
+	std::vector<TileType*> types;
+
+	//! Where our TileTypes live. Sets read from TSX files are shared
+	//! with other Areas. See TileSets.
+	std::vector<std::shared_ptr<TileTypeSet>> typeSets;
+
+	//! Copies of shared TileTypes that we changed. See ownType().
+	std::vector<std::unique_ptr<TileType>> typeCopies;
+
+	//! TileTypes that only we use and may change.
+	std::unordered_set<const TileType*> ownTypes;
+
+	//! Scripts attached to TileTypes. They are kept here because
+	//! TileTypes may be shared with Areas that have other scripts.
+	std::unordered_map<const TileType*, TileScripts> typeScripts;
+
+	//! Tiles, by tileIndex(), and TileTypes that were changed since the
+	//! Area was built. See saveState().
+	std::unordered_set<size_t> changedTiles;
+	std::unordered_set<TileType*> changedTypes;
+
 	//! Maps virtual float-point depths to an index in our map array.
-	std::map<double, int> depth2idx;
+	//! Kept sorted by depth. Areas have only a handful of layers, so a
+	//! binary search over a flat array is cheaper than walking a tree.
+	std::vector<std::pair<double, int>> depth2idx;
 
 	//! Maps an index in our map array to a virtual float-point depth.
 	std::vector<double> idx2depth;
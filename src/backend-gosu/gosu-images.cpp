@@ -24,6 +24,10 @@
 // IN THE SOFTWARE.
 // **********
 
+#include <algorithm>
+#include <map>
+#include <string.h>
+
 #include <Gosu/Bitmap.hpp>
 #include <Gosu/Graphics.hpp>
 #include <Gosu/Image.hpp>
@@ -32,6 +36,10 @@
 #include "gosu-cbuffer.h"
 #include "gosu-images.h"
 #include "gosu-window.h"
+#include "../client-conf.h"
+#include "../decoded-cache.h"
+#include "../formatter.h"
+#include "../log.h"
 #include "../resources.h"
 #include "../window.h"
 
@@ -43,8 +51,9 @@ static Gosu::Graphics& graphics()
 }
 
 
-GosuImage::GosuImage(Gosu::Image&& image)
-	: image(std::move(image))
+GosuImage::GosuImage(Gosu::Image&& image, Opacity opacity,
+                     std::shared_ptr<GosuAtlas::Sheet> sheet)
+	: image(std::move(image)), opacity_(opacity), sheet(std::move(sheet))
 {
 }
 
@@ -73,6 +82,11 @@ unsigned GosuImage::height() const
 	return image.height();
 }
 
+Opacity GosuImage::opacity() const
+{
+	return opacity_;
+}
+
 
 GosuTiledImage::GosuTiledImage(std::vector<std::shared_ptr<Image>>&& images)
 	: images(std::move(images))
@@ -90,6 +104,176 @@ const std::shared_ptr<Image>& GosuTiledImage::operator[](size_t n) const
 }
 
 
+//! Width and height in pixels of each atlas page. No larger than the
+//! smallest maximum texture size Gosu supports, so a page is one texture.
+#define ATLAS_PAGE_SIZE 1024
+
+struct GosuAtlas::Page
+{
+	Page();
+
+	//! Find a place for a w by h bitmap, and mark it used.
+	bool fit(unsigned w, unsigned h, unsigned* x, unsigned* y);
+
+	//! Give back the place of a bitmap that is gone.
+	void release(unsigned x, unsigned y, unsigned w, unsigned h);
+
+	//! Images of tiles are made from parts of this.
+	Gosu::Image image;
+
+	//! A row of the page. Bitmaps no taller than it are placed wherever
+	//! a free span of it is wide enough.
+	struct Shelf
+	{
+		unsigned y, h;
+
+		//! Widths of the free spans, by x.
+		std::map<unsigned, unsigned> free;
+	};
+
+	//! Top to bottom. The page below the last shelf is unused.
+	std::vector<Shelf> shelves;
+
+	//! Pixels covered by live sheets.
+	size_t usedPixels;
+};
+
+GosuAtlas::Page::Page()
+	: image(Gosu::Bitmap(ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE),
+	        Gosu::ifTileable),
+	  usedPixels(0)
+{
+}
+
+bool GosuAtlas::Page::fit(unsigned w, unsigned h, unsigned* x, unsigned* y)
+{
+	// Use the shortest shelf that has room, so short bitmaps don't use
+	// up tall shelves.
+	Shelf* best = NULL;
+	std::map<unsigned, unsigned>::iterator span;
+	for (Shelf& shelf : shelves) {
+		if (h > shelf.h || (best && shelf.h >= best->h))
+			continue;
+		for (auto it = shelf.free.begin(); it != shelf.free.end();
+		     it++) {
+			if (it->second >= w) {
+				best = &shelf;
+				span = it;
+				break;
+			}
+		}
+	}
+
+	if (!best) {
+		unsigned top = shelves.empty() ? 0 :
+			shelves.back().y + shelves.back().h;
+		if (top + h > ATLAS_PAGE_SIZE)
+			return false;
+		Shelf shelf;
+		shelf.y = top;
+		shelf.h = h;
+		shelf.free[0] = ATLAS_PAGE_SIZE;
+		shelves.push_back(std::move(shelf));
+		best = &shelves.back();
+		span = best->free.begin();
+	}
+
+	*x = span->first;
+	*y = best->y;
+	unsigned rest = span->second - w;
+	best->free.erase(span);
+	if (rest)
+		best->free[*x + w] = rest;
+	usedPixels += (size_t)w * h;
+	return true;
+}
+
+void GosuAtlas::Page::release(unsigned x, unsigned y, unsigned w, unsigned h)
+{
+	usedPixels -= (size_t)w * h;
+
+	for (Shelf& shelf : shelves) {
+		if (shelf.y != y)
+			continue;
+
+		// Join the span with free ones next to it.
+		auto next = shelf.free.lower_bound(x);
+		if (next != shelf.free.end() && next->first == x + w) {
+			w += next->second;
+			next = shelf.free.erase(next);
+		}
+		if (next != shelf.free.begin() &&
+		    std::prev(next)->first + std::prev(next)->second == x)
+			std::prev(next)->second += w;
+		else
+			shelf.free[x] = w;
+		break;
+	}
+
+	// Empty shelves at the bottom give their rows back to the page, so
+	// they can be used by bitmaps of any height.
+	while (!shelves.empty() && shelves.back().free.size() == 1 &&
+	       shelves.back().free.begin()->second == ATLAS_PAGE_SIZE)
+		shelves.pop_back();
+}
+
+GosuAtlas::Sheet::Sheet(std::shared_ptr<Page> page, unsigned x, unsigned y,
+                        unsigned w, unsigned h)
+	: page(std::move(page)), x(x), y(y), w(w), h(h)
+{
+}
+
+GosuAtlas::Sheet::~Sheet()
+{
+	page->release(x, y, w, h);
+}
+
+std::shared_ptr<GosuAtlas::Sheet> GosuAtlas::place(const Gosu::Bitmap& bitmap)
+{
+	unsigned w = bitmap.width(), h = bitmap.height();
+	if (w > ATLAS_PAGE_SIZE || h > ATLAS_PAGE_SIZE)
+		return NULL;
+
+	pages.erase(std::remove_if(pages.begin(), pages.end(),
+		[](const std::weak_ptr<Page>& page) {
+			return page.expired();
+		}), pages.end());
+
+	unsigned x, y;
+	std::shared_ptr<Page> found;
+	for (auto& weak : pages) {
+		auto page = weak.lock();
+		if (page->fit(w, h, &x, &y)) {
+			found = page;
+			break;
+		}
+	}
+	if (!found) {
+		found = std::make_shared<Page>();
+		pages.push_back(found);
+		found->fit(w, h, &x, &y);
+	}
+
+	found->image.getData().insert(bitmap, (int)x, (int)y);
+	return std::make_shared<Sheet>(found, x, y, w, h);
+}
+
+void GosuAtlas::reportOccupancy()
+{
+	size_t used = 0, live = 0;
+	for (auto& weak : pages) {
+		auto page = weak.lock();
+		if (page) {
+			used += page->usedPixels;
+			live++;
+		}
+	}
+	size_t total = live * ATLAS_PAGE_SIZE * ATLAS_PAGE_SIZE;
+	Log::info("Atlas", Formatter("% pages, %/% pixels used") % live %
+		used % total);
+}
+
+
 static GosuImages globalImages;
 
 Images& Images::instance()
@@ -97,46 +281,128 @@ Images& Images::instance()
 	return globalImages;
 }
 
-static std::shared_ptr<Image> genImage(const std::string& path)
+//! Decode an image file, or read it back from the DecodedCache if an
+//! earlier run already decoded it.
+static void loadBitmap(Resource& r, Gosu::Bitmap& bitmap)
+{
+	if (!conf.decodedCache) {
+		GosuCBuffer buffer(r.data(), r.size());
+		Gosu::loadImageFile(bitmap, buffer.frontReader());
+		return;
+	}
+
+	DecodedCache& cache = DecodedCache::instance();
+	uint64_t key = DecodedCache::key(r.data(), r.size());
+
+	std::unique_ptr<DecodedBitmap> decoded = cache.load(key);
+	if (decoded) {
+		unsigned w = decoded->width(), h = decoded->height();
+		bitmap.resize(w, h);
+		memcpy((void*)bitmap.data(), decoded->pixels(),
+		       w * h * sizeof(Gosu::Color));
+		return;
+	}
+
+	GosuCBuffer buffer(r.data(), r.size());
+	Gosu::loadImageFile(bitmap, buffer.frontReader());
+	cache.store(key, bitmap.width(), bitmap.height(),
+	            (const uint32_t*)bitmap.data());
+}
+
+static std::shared_ptr<Image> genImage(const std::string& path,
+                                       size_t* bytes)
 {
 	std::unique_ptr<Resource> r = Resources::instance().load(path);
 	if (!r) {
 		// Error logged.
 		return std::shared_ptr<Image>();
 	}
-	GosuCBuffer buffer(r->data(), r->size());
 	Gosu::Bitmap bitmap;
-	Gosu::loadImageFile(bitmap, buffer.frontReader());
+	loadBitmap(*r, bitmap);
+	*bytes = bitmap.width() * bitmap.height() * sizeof(Gosu::Color);
 	return std::make_shared<GosuImage>(std::move(Gosu::Image(bitmap, Gosu::ifTileable)));
 }
 
-static std::shared_ptr<TiledImage> genTiledImage(const std::string& path,
-	unsigned tileW, unsigned tileH)
+//! Look at the alpha channel of a rectangle of a Bitmap to find out if it
+//! would hide what is drawn beneath it.
+static Opacity classifyOpacity(const Gosu::Bitmap& bitmap,
+	unsigned x, unsigned y, unsigned w, unsigned h)
+{
+	unsigned x2 = std::min(x + w, bitmap.width());
+	unsigned y2 = std::min(y + h, bitmap.height());
+	bool opaque = true, transparent = true;
+
+	for (unsigned py = y; py < y2; py++) {
+		const Gosu::Color* row = bitmap.data() + py * bitmap.width();
+		for (unsigned px = x; px < x2; px++) {
+			Gosu::Color::Channel alpha = row[px].alpha();
+			opaque = opaque && alpha == 255;
+			transparent = transparent && alpha == 0;
+		}
+		if (!opaque && !transparent)
+			return OPACITY_PARTIAL;
+	}
+
+	if (x2 - x < w || y2 - y < h)
+		// Runs off the edge of the Bitmap.
+		opaque = false;
+	if (opaque)
+		return OPACITY_OPAQUE;
+	if (transparent)
+		return OPACITY_TRANSPARENT;
+	return OPACITY_PARTIAL;
+}
+
+static std::shared_ptr<TiledImage> genTiledImage(GosuAtlas& atlas,
+	const std::string& path, unsigned tileW, unsigned tileH,
+	size_t* bytes)
 {
 	std::unique_ptr<Resource> r = Resources::instance().load(path);
 	if (!r) {
 		// Error logged.
 		return std::shared_ptr<TiledImage>();
 	}
-	GosuCBuffer buffer(r->data(), r->size());
 	Gosu::Bitmap bitmap;
-	Gosu::loadImageFile(bitmap, buffer.frontReader());
+	loadBitmap(*r, bitmap);
+	*bytes = bitmap.width() * bitmap.height() * sizeof(Gosu::Color);
+
+	// Put the whole sheet on an atlas page and cut the tiles out of it
+	// there. Tiles are drawn with nearest-neighbor filtering, so they
+	// don't bleed into their neighbors on the page. Sheets that don't
+	// divide evenly into tiles get their own images.
+	std::shared_ptr<GosuAtlas::Sheet> sheet;
+	if (bitmap.width() % tileW == 0 && bitmap.height() % tileH == 0)
+		sheet = atlas.place(bitmap);
+
 	std::vector<std::shared_ptr<Image>> images;
 	for (unsigned y = 0; y < bitmap.height(); y += tileH) {
 		for (unsigned x = 0; x < bitmap.width(); x += tileW) {
+			std::unique_ptr<Gosu::ImageData> data;
+			std::shared_ptr<GosuAtlas::Sheet> onSheet;
+			if (sheet) {
+				onSheet = sheet;
+				data = sheet->page->image.getData().subimage(
+					(int)(sheet->x + x), (int)(sheet->y + y),
+					(int)tileW, (int)tileH);
+			}
 			images.emplace_back(std::make_shared<GosuImage>(
-				std::move(Gosu::Image(
-					bitmap, x, y, tileW, tileH, Gosu::ifTileable
-				))
+				data ?
+					Gosu::Image(std::move(data)) :
+					Gosu::Image(bitmap, x, y, tileW, tileH,
+					            Gosu::ifTileable),
+				classifyOpacity(bitmap, x, y, tileW, tileH),
+				onSheet
 			));
 		}
 	}
+	if (sheet)
+		atlas.reportOccupancy();
 	return std::make_shared<GosuTiledImage>(std::move(images));
 }
 
 
 GosuImages::GosuImages()
-	: images(genImage)
+	: images("images", genImage), tiledImages("tiled images")
 {
 }
 
@@ -148,12 +414,23 @@ std::shared_ptr<Image> GosuImages::load(const std::string& path)
 std::shared_ptr<TiledImage> GosuImages::loadTiles(const std::string& path,
 	unsigned tileW, unsigned tileH)
 {
-	auto tiledImage = tiledImages.lifetimeRequest(path);
-	if (!tiledImage) {
-		tiledImage = genTiledImage(path, tileW, tileH);
-		tiledImages.lifetimePut(path, tiledImage);
-	}
-	return tiledImage;
+	return tiledImages.lifetimeLoad(path, [&](size_t* bytes) {
+		return genTiledImage(atlas, path, tileW, tileH, bytes);
+	});
+}
+
+bool GosuImages::beginRecording()
+{
+	graphics().beginRecording();
+	return true;
+}
+
+std::shared_ptr<Image> GosuImages::endRecording(unsigned width,
+	unsigned height)
+{
+	return std::make_shared<GosuImage>(std::move(Gosu::Image(
+		graphics().endRecording((int)width, (int)height)
+	)));
 }
 
 void GosuImages::garbageCollect()
@@ -34,12 +34,48 @@
 #include "../images.h"
 #include "../readercache.h"
 
-namespace Gosu { class Image; }
+namespace Gosu { class Bitmap; class Image; }
+
+/**
+ * A few large textures that the images of tiles are packed into, so that
+ * drawing Tiles from different tilesets and Entities switches textures less
+ * often and costs fewer draws of separate images.
+ */
+class GosuAtlas
+{
+public:
+	struct Page;
+
+	//! Where a bitmap was placed. Held by every image cut from it, and
+	//! gives the place back to the page when the last of them is gone.
+	struct Sheet
+	{
+		Sheet(std::shared_ptr<Page> page, unsigned x, unsigned y,
+		      unsigned w, unsigned h);
+		~Sheet();
+
+		std::shared_ptr<Page> page;
+		unsigned x, y, w, h;
+	};
+
+	//! Copy a bitmap onto a page, finding a place for it. Returns NULL
+	//! if it doesn't fit on a page.
+	std::shared_ptr<Sheet> place(const Gosu::Bitmap& bitmap);
+
+	//! Log how much of the pages is in use.
+	void reportOccupancy();
+
+private:
+	//! Pages live as long as the sheets on them.
+	std::vector<std::weak_ptr<Page>> pages;
+};
+
 
 class GosuImage : public Image
 {
 public:
-	GosuImage(Gosu::Image&& image);
+	GosuImage(Gosu::Image&& image, Opacity opacity = OPACITY_UNKNOWN,
+	          std::shared_ptr<GosuAtlas::Sheet> sheet = NULL);
 	~GosuImage() = default;
 
 	void draw(double dstX, double dstY, double z);
@@ -49,9 +85,14 @@ public:
 
 	unsigned width() const;
 	unsigned height() const;
+	Opacity opacity() const;
 
 private:
 	Gosu::Image image;
+	Opacity opacity_;
+
+	//! The part of an atlas page the image is drawn from, if any.
+	std::shared_ptr<GosuAtlas::Sheet> sheet;
 };
 
 
@@ -81,6 +122,9 @@ public:
 	std::shared_ptr<TiledImage> loadTiles(const std::string& path,
 		unsigned tileW, unsigned tileH);
 
+	bool beginRecording();
+	std::shared_ptr<Image> endRecording(unsigned width, unsigned height);
+
 	void garbageCollect();
 
 private:
@@ -92,6 +136,8 @@ private:
 	// with three arguments, but a ReaderCache only supports the use of
 	// one.
 	Cache<std::shared_ptr<TiledImage>> tiledImages;
+
+	GosuAtlas atlas;
 };
 
 #endif
@@ -32,13 +32,16 @@
 #include "gosu-cbuffer.h"
 #include "gosu-music.h"
 
-static std::shared_ptr<Gosu::Song> genSong(const std::string& name)
+static std::shared_ptr<Gosu::Song> genSong(const std::string& name,
+                                           size_t* bytes)
 {
 	std::unique_ptr<Resource> r = Resources::instance().load(name);
 	if (!r) {
 		// Error logged.
 		return std::shared_ptr<Gosu::Song>();
 	}
+	// Songs keep their file in memory and decode it as they play.
+	*bytes = r->size();
 	GosuCBuffer buffer(r->data(), r->size());
 	return std::shared_ptr<Gosu::Song>(
 		new Gosu::Song(buffer.frontReader())
@@ -54,7 +57,7 @@ Music& Music::instance()
 }
 
 
-GosuMusic::GosuMusic() : songs(genSong)
+GosuMusic::GosuMusic() : songs("songs", genSong)
 {
 }
 
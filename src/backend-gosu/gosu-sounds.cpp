@@ -108,13 +108,17 @@ void GosuSoundInstance::speed(double attemptedSpeed)
 }
 
 
-static std::shared_ptr<Gosu::Sample> genSample(const std::string& path)
+static std::shared_ptr<Gosu::Sample> genSample(const std::string& path,
+                                               size_t* bytes)
 {
 	std::unique_ptr<Resource> r = Resources::instance().load(path);
 	if (!r) {
 		// Error logged.
 		return std::shared_ptr<Gosu::Sample>();
 	}
+	// Gosu doesn't say how large the decoded sample is, so count the
+	// file it came from.
+	*bytes = r->size();
 	GosuCBuffer buffer(r->data(), r->size());
 	return std::make_shared<Gosu::Sample>(buffer.frontReader());
 }
@@ -127,7 +131,7 @@ Sounds& Sounds::instance()
 }
 
 GosuSounds::GosuSounds()
-	: samples(genSample)
+	: samples("samples", genSample)
 {
 }
 
@@ -141,6 +145,16 @@ std::shared_ptr<SoundInstance> GosuSounds::play(const std::string& path)
 	return std::make_shared<GosuSoundInstance>(sample->play());
 }
 
+std::shared_ptr<SoundInstance> GosuSounds::play(ResourceId id)
+{
+	auto sample = samples.lifetimeRequest(id);
+	if (!sample) {
+		// Error logged, or no sound asked for.
+		return std::shared_ptr<GosuSoundInstance>();
+	}
+	return std::make_shared<GosuSoundInstance>(sample->play());
+}
+
 void GosuSounds::garbageCollect()
 {
 	samples.garbageCollect();
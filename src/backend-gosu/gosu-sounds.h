@@ -68,6 +68,7 @@ public:
 	~GosuSounds() = default;
 
 	std::shared_ptr<SoundInstance> play(const std::string& path);
+	std::shared_ptr<SoundInstance> play(ResourceId id);
 
 	void garbageCollect();
 
@@ -35,8 +35,9 @@
 
 #define ASSERT(x)  if (!(x)) { return false; }
 
-// Garbage collection called every X milliseconds
-#define GC_CALL_PERIOD 10 * 1000
+// Garbage collection called every X milliseconds. Each call does a bounded
+// amount of work.
+#define GC_CALL_PERIOD 100
 
 namespace Gosu {
 	/**
@@ -157,6 +158,9 @@ void GosuGameWindow::draw()
 
 bool GosuGameWindow::needsRedraw() const
 {
+	// Gosu calls update() at a fixed rate and can't be asked to wait
+	// longer, so instead of sleeping until World::nextRedrawTime() we skip
+	// drawing until then.
 	return World::instance().needsRedraw();
 }
 
@@ -27,7 +27,8 @@
 #ifndef CACHE_TEMPLATE_CPP
 #define CACHE_TEMPLATE_CPP
 
-#include <vector>
+#include <chrono>
+#include <functional>
 
 #include "cache.h"
 #include "client-conf.h"
@@ -35,89 +36,424 @@
 #include "world.h"
 
 #define IN_USE_NOW -1
+#define NO_SLOT ((size_t)-1)
+
+// Entries looked at, and entries purged, by each garbageCollect() step.
+#define GC_STEP_ENTRIES 32
+
+template<class T>
+Cache<T>::Cache(const char* name)
+	: CacheBase(name), gcShard(0)
+{
+	for (Shard& shard : shards)
+		shard.owner = this;
+}
 
 template<class T>
 T Cache<T>::momentaryRequest(const std::string& name)
 {
-	if (conf.cacheEnabled) {
-		CacheMapIter it = map.find(name);
-		if (it != map.end()) {
-//			Log::info("Cache", name + ": requested (cached)");
-			CacheEntry& entry = it->second;
-			// Set lastUsed to now because it won't be used
-			// by the time garbageCollect() gets to it.
-			entry.lastUsed = World::instance().time();
-			return entry.resource;
-		}
-	}
-	Log::info("Cache", name + ": requested");
-	return T();
+	// Set lastUsed to now because it won't be used by the time
+	// garbageCollect() gets to it.
+	return request(name, World::instance().time());
 }
 
 template<class T>
 T Cache<T>::lifetimeRequest(const std::string& name)
+{
+	return request(name, IN_USE_NOW);
+}
+
+template<class T>
+void Cache<T>::momentaryPut(const std::string& name, T data, size_t bytes)
+{
+	put(name, data, bytes, World::instance().time());
+}
+
+template<class T>
+void Cache<T>::lifetimePut(const std::string& name, T data, size_t bytes)
+{
+	put(name, data, bytes, IN_USE_NOW);
+}
+
+template<class T>
+template<class Gen>
+T Cache<T>::momentaryLoad(const std::string& name, Gen gen)
+{
+	return load(name, std::hash<std::string>()(name), NO_SLOT, gen,
+	            World::instance().time());
+}
+
+template<class T>
+template<class Gen>
+T Cache<T>::lifetimeLoad(const std::string& name, Gen gen)
+{
+	return load(name, std::hash<std::string>()(name), NO_SLOT, gen,
+	            IN_USE_NOW);
+}
+
+template<class T>
+template<class Gen>
+T Cache<T>::momentaryLoad(ResourceId id, Gen gen)
+{
+	if (!id)
+		return T();
+	return load(id.path(), id.hash(), id.index(), gen,
+	            World::instance().time());
+}
+
+template<class T>
+template<class Gen>
+T Cache<T>::lifetimeLoad(ResourceId id, Gen gen)
+{
+	if (!id)
+		return T();
+	return load(id.path(), id.hash(), id.index(), gen, IN_USE_NOW);
+}
+
+template<class T>
+void Cache<T>::garbageCollect()
+{
+	if (!conf.cacheEnabled)
+		return;
+	time_t now = World::instance().time();
+	{
+		Shard& shard = shards[gcShard++ % CACHE_SHARDS];
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		shard.collect(now);
+	}
+
+	// Resources given back since they were put may let us get under
+	// budget now. Evict no more than a step's worth at a time.
+	enforceBudget(GC_STEP_ENTRIES, false);
+}
+
+template<class T>
+void Cache<T>::findReleased()
+{
+	for (Shard& shard : shards) {
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		for (CacheEntry* entry : shard.lru)
+			if (!entry->resource || entry->resource.unique())
+				shard.setEvictable(*entry, true);
+	}
+}
+
+template<class T>
+bool Cache<T>::oldestEvictable(unsigned long* tick)
+{
+	return oldestShard(tick) != NULL;
+}
+
+template<class T>
+void Cache<T>::evictOldest()
+{
+	unsigned long tick;
+	Shard* shard = oldestShard(&tick);
+	if (!shard)
+		return;
+	std::lock_guard<std::mutex> lock(shard->mutex);
+	// It may have been used or evicted since we looked.
+	CacheEntry* entry = shard->findEvictable();
+	if (!entry)
+		return;
+	Log::info("Cache", *entry->name + ": evicted");
+	shard->erase(*entry);
+	evictions++;
+}
+
+template<class T>
+typename Cache<T>::Shard& Cache<T>::shardOf(size_t hash)
+{
+	return shards[hash % CACHE_SHARDS];
+}
+
+template<class T>
+T Cache<T>::request(const std::string& name, time_t lastUsed)
 {
 	if (conf.cacheEnabled) {
-		typename CacheMap::iterator it = map.find(name);
-		if (it != map.end()) {
-//			Log::info("Cache", name + ": requested (cached)");
-			CacheEntry& entry = it->second;
-			entry.lastUsed = IN_USE_NOW;
-			return entry.resource;
-		}
+		Shard& shard = shardOf(std::hash<std::string>()(name));
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		T t = shard.get(name, NO_SLOT, lastUsed);
+		if (t)
+			return t;
 	}
+	misses++;
 	Log::info("Cache", name + ": requested");
 	return T();
 }
 
 template<class T>
-void Cache<T>::momentaryPut(const std::string& name, T data)
+void Cache<T>::put(const std::string& name, T data, size_t bytes,
+                   time_t lastUsed)
 {
 	if (!conf.cacheEnabled)
 		return;
-	CacheEntry entry;
-	entry.resource = data;
-	time_t now = World::instance().time();
-	entry.lastUsed = now;
-	map[name] = entry;
+	{
+		Shard& shard = shardOf(std::hash<std::string>()(name));
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		shard.put(name, NO_SLOT, data, bytes, lastUsed);
+	}
+	// The caller still holds data, so it won't be the one evicted.
+	enforceBudget((size_t)-1, true);
 }
 
 template<class T>
-void Cache<T>::lifetimePut(const std::string& name, T data)
+template<class Gen>
+T Cache<T>::load(const std::string& name, size_t hash, size_t slot, Gen gen,
+                 time_t lastUsed)
 {
-	if (!conf.cacheEnabled)
-		return;
-	CacheEntry entry;
+	size_t bytes = 0;
+	if (!conf.cacheEnabled) {
+		misses++;
+		Log::info("Cache", name + ": requested");
+		return generate(gen, &bytes);
+	}
+
+	Shard& shard = shardOf(hash);
+	std::promise<T> promise;
+	{
+		std::unique_lock<std::mutex> lock(shard.mutex);
+		T t = shard.get(name, slot, lastUsed);
+		if (t)
+			return t;
+
+		auto loading = shard.loading.find(name);
+		if (loading != shard.loading.end()) {
+			std::shared_future<T> future = loading->second;
+			lock.unlock();
+			waits++;
+			return future.get();
+		}
+		shard.loading[name] = promise.get_future().share();
+	}
+	misses++;
+	Log::info("Cache", name + ": requested");
+
+	T t;
+	try {
+		t = generate(gen, &bytes);
+	}
+	catch (...) {
+		// Let whoever waits on us see the error too.
+		{
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			shard.loading.erase(name);
+		}
+		promise.set_exception(std::current_exception());
+		throw;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		shard.loading.erase(name);
+		if (t)
+			shard.put(name, slot, t, bytes, lastUsed);
+	}
+	promise.set_value(t);
+	enforceBudget((size_t)-1, true);
+	return t;
+}
+
+template<class T>
+template<class Gen>
+T Cache<T>::generate(Gen gen, size_t* bytes)
+{
+	struct Loading {
+		Loading(std::atomic<unsigned long>& n) : n(n) { n++; }
+		~Loading() { n--; }
+		std::atomic<unsigned long>& n;
+	} counted(loading);
+
+	auto start = std::chrono::steady_clock::now();
+	T t = gen(bytes);
+	countLoadTime((long)std::chrono::duration_cast<
+		std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - start).count());
+	return t;
+}
+
+template<class T>
+typename Cache<T>::Shard* Cache<T>::oldestShard(unsigned long* tick)
+{
+	Shard* oldest = NULL;
+	for (Shard& shard : shards) {
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		CacheEntry* entry = shard.findEvictable();
+		if (entry && (!oldest || entry->tick < *tick)) {
+			oldest = &shard;
+			*tick = entry->tick;
+		}
+	}
+	return oldest;
+}
+
+template<class T>
+Cache<T>::Shard::Shard()
+	: sweep(lru.end())
+{
+}
+
+template<class T>
+typename Cache<T>::CacheEntry* Cache<T>::Shard::find(const std::string& name,
+                                                     size_t slot)
+{
+	if (slot != NO_SLOT && slot < slots.size() && slots[slot])
+		return slots[slot];
+
+	CacheMapIter it = map.find(name);
+	if (it == map.end())
+		return NULL;
+	CacheEntry& entry = it->second;
+	if (slot != NO_SLOT) {
+		if (slots.size() <= slot)
+			slots.resize(slot + 1);
+		slots[slot] = &entry;
+		entry.slot = slot;
+	}
+	return &entry;
+}
+
+template<class T>
+T Cache<T>::Shard::get(const std::string& name, size_t slot,
+                       time_t lastUsed)
+{
+	CacheEntry* found = find(name, slot);
+	if (!found)
+		return T();
+//	Log::info("Cache", name + ": requested (cached)");
+	owner->hits++;
+	CacheEntry& entry = *found;
+	setLastUsed(entry, lastUsed);
+	touch(entry);
+	return entry.resource;
+}
+
+template<class T>
+void Cache<T>::Shard::put(const std::string& name, size_t slot, T data,
+                          size_t bytes, time_t lastUsed)
+{
+	CacheEntry* found = find(name, slot);
+	if (found)
+		owner->account(-(long)found->memoryUsed);
+	else {
+		CacheMapIter it = map.insert(
+			std::make_pair(name, CacheEntry())).first;
+		found = &it->second;
+		found->name = &it->first;
+		found->lastUsed = IN_USE_NOW;
+		found->slot = NO_SLOT;
+		found->evictable = false;
+		found->lruPos = lru.insert(lru.end(), found);
+		owner->entries++;
+		// Bind it to the slot, if it has one.
+		find(name, slot);
+	}
+
+	CacheEntry& entry = *found;
 	entry.resource = data;
-	entry.lastUsed = IN_USE_NOW;
-	map[name] = entry;
+	entry.memoryUsed = bytes;
+	setLastUsed(entry, lastUsed);
+	touch(entry);
+	owner->account((long)bytes);
 }
 
+//! Entries are on expiring exactly when lastUsed isn't IN_USE_NOW.
 template<class T>
-void Cache<T>::garbageCollect()
+void Cache<T>::Shard::setLastUsed(CacheEntry& entry, time_t lastUsed)
 {
-	if (!conf.cacheEnabled)
+	if (entry.lastUsed != IN_USE_NOW)
+		expiring.erase(entry.expiryPos);
+	entry.lastUsed = lastUsed;
+	if (lastUsed != IN_USE_NOW)
+		entry.expiryPos = expiring.insert(expiring.end(), &entry);
+}
+
+//! Entries are on evictable exactly when evictable is set.
+template<class T>
+void Cache<T>::Shard::setEvictable(CacheEntry& entry, bool evictable)
+{
+	if (entry.evictable == evictable)
 		return;
-	time_t now = World::instance().time();
-	typedef std::vector<std::string> StringVector;
-	StringVector dead;
-	for (CacheMapIter it = map.begin(); it != map.end(); it++) {
-		const std::string& name = it->first;
-		CacheEntry& cache = it->second;
-		bool unused = !cache.resource || cache.resource.unique();
+	entry.evictable = evictable;
+	if (evictable) {
+		entry.evictablePos = this->evictable.insert(
+			this->evictable.end(), &entry);
+		noteReleased();
+	}
+	else
+		this->evictable.erase(entry.evictablePos);
+}
+
+template<class T>
+void Cache<T>::Shard::touch(CacheEntry& entry)
+{
+	// Whoever touched it is about to hold it.
+	setEvictable(entry, false);
+
+	// Don't let the sweep follow the entry to the end and skip the rest.
+	if (sweep == entry.lruPos)
+		sweep++;
+	lru.splice(lru.end(), lru, entry.lruPos);
+	entry.tick = nextTick();
+}
+
+template<class T>
+void Cache<T>::Shard::erase(CacheEntry& entry)
+{
+	owner->account(-(long)entry.memoryUsed);
+	owner->entries--;
+	setLastUsed(entry, IN_USE_NOW);
+	setEvictable(entry, false);
+	if (sweep == entry.lruPos)
+		sweep++;
+	if (entry.slot != NO_SLOT)
+		slots[entry.slot] = NULL;
+	lru.erase(entry.lruPos);
+	map.erase(map.find(*entry.name));
+}
+
+template<class T>
+typename Cache<T>::CacheEntry* Cache<T>::Shard::findEvictable()
+{
+	return evictable.empty() ? NULL : evictable.front();
+}
+
+template<class T>
+void Cache<T>::Shard::collect(time_t now)
+{
+	// Carry on around lru looking for entries that were let go.
+	for (int i = 0; i < GC_STEP_ENTRIES && !lru.empty(); i++) {
+		if (sweep == lru.end())
+			sweep = lru.begin();
+		CacheEntry& entry = **sweep;
+		sweep++;
+		bool unused = !entry.resource || entry.resource.unique();
 		if (!unused)
 			continue;
-		if (cache.lastUsed == IN_USE_NOW) {
-			cache.lastUsed = now;
-//			Log::info("Cache", name + ": unused");
+		// No one can take it without going through us, which takes
+		// it off evictable again.
+		setEvictable(entry, true);
+		if (entry.lastUsed == IN_USE_NOW) {
+			setLastUsed(entry, now);
+//			Log::info("Cache", *entry.name + ": unused");
 		}
-		else if (now > cache.lastUsed + conf.cacheTTL*1000) {
-			dead.push_back(name);
-			Log::info("Cache", name + ": purged");
+	}
+
+	// Purge from the front of expiring. Anything held again goes back
+	// to waiting for the sweep to find it let go.
+	for (int i = 0; i < GC_STEP_ENTRIES && !expiring.empty(); i++) {
+		CacheEntry& entry = *expiring.front();
+		if (now <= entry.lastUsed + conf.cacheTTL*1000)
+			break;
+		bool unused = !entry.resource || entry.resource.unique();
+		if (!unused) {
+			setLastUsed(entry, IN_USE_NOW);
+			continue;
 		}
+		Log::info("Cache", *entry.name + ": purged");
+		erase(entry);
+		owner->purges++;
 	}
-	for (StringVector::iterator it = dead.begin(); it != dead.end(); it++)
-		map.erase(*it);
 }
 
 #endif
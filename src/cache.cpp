@@ -0,0 +1,250 @@
+/**********************************
+** Tsunagari Tile Engine         **
+** cache.cpp                     **
+** Copyright 2015 PariahSoft LLC **
+**********************************/
+
+// **********
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+// **********
+
+
+#include <fstream>
+#include <sstream>
+
+#include "cache.h"
+#include "client-conf.h"
+#include "formatter.h"
+#include "log.h"
+
+//! Upper bounds, in microseconds, of the buckets of the load time
+//! histogram. A last bucket holds anything longer.
+static const long LOAD_TIME_BOUNDS[CACHE_LOAD_BUCKETS - 1] = {
+	100, 1000, 10000, 100000, 1000000
+};
+
+static CacheBase* caches = NULL;
+static std::atomic<size_t> total(0);
+static std::atomic<unsigned long> ticks(0);
+static std::atomic<bool> dumpRequested(false);
+
+//! Counts resources becoming evictable. If it hasn't moved since
+//! enforceBudget() last found nothing to evict, there still is nothing.
+static std::atomic<unsigned long> releases(1);
+static std::atomic<unsigned long> exhaustedAt(0);
+
+size_t CacheBase::totalBytes()
+{
+	return total;
+}
+
+std::vector<CacheStats> CacheBase::allStats()
+{
+	std::lock_guard<std::mutex> lock(registry());
+	std::vector<CacheStats> all;
+	for (CacheBase* cache = caches; cache; cache = cache->next)
+		all.push_back(cache->stats());
+	return all;
+}
+
+long CacheBase::loadTimeBound(size_t i)
+{
+	return LOAD_TIME_BOUNDS[i];
+}
+
+std::string CacheBase::statsJSON()
+{
+	std::ostringstream json;
+	json << "{\n";
+	json << "\t\"totalBytes\": " << totalBytes() << ",\n";
+	json << "\t\"budgetBytes\": " <<
+		(size_t)conf.cacheSize * 1024 * 1024 << ",\n";
+	json << "\t\"loadTimeBoundsMicros\": [";
+	for (size_t i = 0; i < CACHE_LOAD_BUCKETS - 1; i++)
+		json << (i ? ", " : "") << LOAD_TIME_BOUNDS[i];
+	json << "],\n";
+	json << "\t\"caches\": [";
+
+	std::vector<CacheStats> all = allStats();
+	for (size_t i = 0; i < all.size(); i++) {
+		const CacheStats& s = all[i];
+		json << (i ? ",\n" : "\n") << "\t\t{";
+		json << "\"name\": \"" << s.name << "\", ";
+		json << "\"hits\": " << s.hits << ", ";
+		json << "\"misses\": " << s.misses << ", ";
+		json << "\"waits\": " << s.waits << ", ";
+		json << "\"loading\": " << s.loading << ", ";
+		json << "\"evictions\": " << s.evictions << ", ";
+		json << "\"purges\": " << s.purges << ", ";
+		json << "\"entries\": " << s.entries << ", ";
+		json << "\"bytes\": " << s.bytes << ", ";
+		json << "\"loadTimes\": [";
+		for (size_t b = 0; b < CACHE_LOAD_BUCKETS; b++)
+			json << (b ? ", " : "") << s.loadTimes[b];
+		json << "]}";
+	}
+	json << "\n\t]\n}\n";
+	return json.str();
+}
+
+void CacheBase::requestDump()
+{
+	dumpRequested = true;
+}
+
+void CacheBase::dumpIfRequested()
+{
+	if (!dumpRequested.exchange(false))
+		return;
+	std::ofstream file(CACHE_STATS_PATH);
+	file << statsJSON();
+	if (!file)
+		Log::err(CACHE_STATS_PATH, "could not write cache statistics");
+	else
+		Log::info("Cache", Formatter("statistics written to %") %
+			CACHE_STATS_PATH);
+}
+
+void CacheBase::reportStats()
+{
+	for (const CacheStats& s : allStats()) {
+		unsigned long requests = s.hits + s.misses + s.waits;
+		Log::info("Cache", Formatter("%: % requests, % hits, "
+			"% evicted, % purged, % entries in % KiB") %
+			s.name % requests % s.hits % s.evictions % s.purges %
+			s.entries % (unsigned long)(s.bytes / 1024));
+	}
+}
+
+CacheStats CacheBase::stats() const
+{
+	CacheStats s;
+	s.name = name;
+	s.hits = hits;
+	s.misses = misses;
+	s.waits = waits;
+	s.loading = loading;
+	s.evictions = evictions;
+	s.purges = purges;
+	s.entries = entries;
+	s.bytes = bytes;
+	for (size_t i = 0; i < CACHE_LOAD_BUCKETS; i++)
+		s.loadTimes[i] = loadTimes[i];
+	return s;
+}
+
+CacheBase::CacheBase(const char* name)
+	: hits(0), misses(0), waits(0), loading(0),
+	  evictions(0), purges(0), entries(0),
+	  prev(NULL), name(name), bytes(0)
+{
+	for (size_t i = 0; i < CACHE_LOAD_BUCKETS; i++)
+		loadTimes[i] = 0;
+
+	std::lock_guard<std::mutex> lock(registry());
+	next = caches;
+	if (next)
+		next->prev = this;
+	caches = this;
+}
+
+CacheBase::~CacheBase()
+{
+	std::lock_guard<std::mutex> lock(registry());
+	if (prev)
+		prev->next = next;
+	else
+		caches = next;
+	if (next)
+		next->prev = prev;
+}
+
+unsigned long CacheBase::nextTick()
+{
+	return ++ticks;
+}
+
+void CacheBase::account(long bytes)
+{
+	if (bytes < 0) {
+		total -= (size_t)-bytes;
+		this->bytes -= (size_t)-bytes;
+	}
+	else {
+		total += (size_t)bytes;
+		this->bytes += (size_t)bytes;
+	}
+}
+
+void CacheBase::countLoadTime(long micros)
+{
+	size_t bucket = 0;
+	while (bucket < CACHE_LOAD_BUCKETS - 1 &&
+	       micros >= LOAD_TIME_BOUNDS[bucket])
+		bucket++;
+	loadTimes[bucket]++;
+}
+
+void CacheBase::enforceBudget(size_t limit, bool findAll)
+{
+	if (conf.cacheSize <= 0)
+		return;
+	size_t budget = (size_t)conf.cacheSize * 1024 * 1024;
+	if (total <= budget)
+		return;
+
+	std::lock_guard<std::mutex> lock(registry());
+	if (findAll)
+		for (CacheBase* cache = caches; cache; cache = cache->next)
+			cache->findReleased();
+	unsigned long seen = releases;
+	if (!findAll && exhaustedAt == seen)
+		return;
+
+	for (size_t evicted = 0; total > budget && evicted < limit;
+	     evicted++) {
+		CacheBase* oldest = NULL;
+		unsigned long oldestTick = 0;
+		for (CacheBase* cache = caches; cache; cache = cache->next) {
+			unsigned long tick;
+			if (cache->oldestEvictable(&tick) &&
+			    (!oldest || tick < oldestTick)) {
+				oldest = cache;
+				oldestTick = tick;
+			}
+		}
+		if (!oldest) {
+			exhaustedAt = seen;
+			return;
+		}
+		oldest->evictOldest();
+	}
+}
+
+void CacheBase::noteReleased()
+{
+	releases++;
+}
+
+std::mutex& CacheBase::registry()
+{
+	// Constructed by the first cache, so it outlives all of them.
+	static std::mutex m;
+	return m;
+}
@@ -27,34 +27,271 @@
 #ifndef CACHE_H
 #define CACHE_H
 
+#include <atomic>
+#include <future>
+#include <list>
 #include <map>
+#include <mutex>
 #include <string>
+#include <vector>
 
+#include "resource-id.h"
+
+// Number of independently locked parts each Cache is split into.
+#define CACHE_SHARDS 8
+
+// Number of buckets in the histogram of load times. See LOAD_TIME_BOUNDS
+// in cache.cpp.
+#define CACHE_LOAD_BUCKETS 6
+
+//! A snapshot of what a Cache has been doing since it was created.
+struct CacheStats
+{
+	std::string name;
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long waits;     //!< Requests that waited on another's load.
+	unsigned long loading;   //!< Loads in progress right now.
+	unsigned long evictions; //!< Entries evicted to stay in budget.
+	unsigned long purges;    //!< Entries purged after their TTL.
+	unsigned long entries;
+	size_t bytes;
+
+	//! Loads counted by how long the generator took. Bucket i holds
+	//! those under loadTimeBound(i) microseconds, and the last bucket
+	//! those longer.
+	unsigned long loadTimes[CACHE_LOAD_BUCKETS];
+};
+
+//! What every Cache shares: one memory budget, conf.cacheSize megabytes,
+//! that they are held to together, and statistics.
+class CacheBase
+{
+public:
+	//! Bytes held by all caches together.
+	static size_t totalBytes();
+
+	//! Statistics of every live cache.
+	static std::vector<CacheStats> allStats();
+
+	//! Upper bound of bucket i of CacheStats::loadTimes, in
+	//! microseconds.
+	static long loadTimeBound(size_t i);
+
+	//! allStats() as a JSON document.
+	static std::string statsJSON();
+
+	//! Ask for statsJSON() to be written to CACHE_STATS_PATH at the next
+	//! dumpIfRequested(). Safe to call from a signal handler.
+	static void requestDump();
+	static void dumpIfRequested();
+
+	//! Log a line of statistics for each cache.
+	static void reportStats();
+
+	CacheStats stats() const;
+
+protected:
+	//! Name is what statistics call the cache.
+	CacheBase(const char* name);
+	virtual ~CacheBase();
+
+	//! A counter that orders uses of resources across all caches.
+	static unsigned long nextTick();
+
+	//! Add or remove bytes from the total and ours.
+	void account(long bytes);
+
+	//! Count a load whose generator took micros microseconds.
+	void countLoadTime(long micros);
+
+	std::atomic<unsigned long> hits, misses, waits, loading;
+	std::atomic<unsigned long> evictions, purges, entries;
+
+	//! Evict the least recently used resources no one holds, in any
+	//! cache, until the total is within budget, nothing is left that
+	//! can go, or limit resources have been evicted. Must not be called
+	//! with a cache's lock held.
+	//!
+	//! With findAll, first look at every entry for resources let go
+	//! since the GC last swept past them, so the budget holds as soon as
+	//! it is exceeded. Otherwise only what the sweep found is evicted,
+	//! and nothing is looked at if that ran out last time.
+	static void enforceBudget(size_t limit, bool findAll);
+
+	//! Note that a resource became evictable, so enforceBudget() should
+	//! look again even if it last found nothing to evict.
+	static void noteReleased();
+
+	//! Make every resource no one holds anymore evictable.
+	virtual void findReleased() = 0;
+
+	//! The tick of the resource we would evict first, or false if there
+	//! is none.
+	virtual bool oldestEvictable(unsigned long* tick) = 0;
+
+	//! Evict the resource oldestEvictable() found.
+	virtual void evictOldest() = 0;
+
+private:
+	CacheBase(const CacheBase&) = delete;
+	CacheBase& operator=(const CacheBase&) = delete;
+
+	//! Guards the list of caches.
+	static std::mutex& registry();
+
+	//! Every live cache, linked through here.
+	CacheBase* prev;
+	CacheBase* next;
+
+	const char* name;
+	std::atomic<size_t> bytes;
+	std::atomic<unsigned long> loadTimes[CACHE_LOAD_BUCKETS];
+};
+
+//! A thread-safe cache of shared resources by name.
+/*!
+	Names are spread by hash over CACHE_SHARDS shards, each with its own
+	lock, so threads working on different resources rarely wait for
+	each other.
+*/
 template<class T>
-class Cache
+class Cache : public CacheBase
 {
 public:
+	Cache(const char* name);
+
 	T momentaryRequest(const std::string& name);
 
 	T lifetimeRequest(const std::string& name);
 
-	void momentaryPut(const std::string& name, T data);
+	//! Bytes is how much memory holding the resource costs.
+	void momentaryPut(const std::string& name, T data, size_t bytes);
+
+	void lifetimePut(const std::string& name, T data, size_t bytes);
 
-	void lifetimePut(const std::string& name, T data);
+	//! Request a resource and, if it isn't cached, make it with
+	//! gen(size_t* bytes) and put it. Gen runs without any lock held.
+	//! Requests for a name already being made wait for that one to
+	//! finish instead of making it again.
+	template<class Gen>
+	T momentaryLoad(const std::string& name, Gen gen);
 
+	template<class Gen>
+	T lifetimeLoad(const std::string& name, Gen gen);
+
+	//! The same, by interned id. Once a resource has been found by its
+	//! id, finding it again is an index into a vector rather than a
+	//! lookup by path.
+	template<class Gen>
+	T momentaryLoad(ResourceId id, Gen gen);
+
+	template<class Gen>
+	T lifetimeLoad(ResourceId id, Gen gen);
+
+	//! Do a bounded step of collection on one shard: look at a few
+	//! entries to see if they are still held, and purge a few that have
+	//! outlived their TTL. Meant to be called often.
 	void garbageCollect();
 
+protected:
+	void findReleased();
+	bool oldestEvictable(unsigned long* tick);
+	void evictOldest();
+
 private:
+	struct CacheEntry;
+	typedef std::list<CacheEntry*> EntryList;
+
 	struct CacheEntry
 	{
+		const std::string* name;
 		T resource;
 		time_t lastUsed; // time in milliseconds
 		size_t memoryUsed;
+		unsigned long tick; // when last requested or put
+		size_t slot; // ResourceId index it's found by, or NO_SLOT
+		bool evictable; // whether on Shard::evictable
+		typename EntryList::iterator lruPos;
+		typename EntryList::iterator expiryPos;
+		typename EntryList::iterator evictablePos;
 	};
 
 	typedef std::map<const std::string, CacheEntry> CacheMap;
 	typedef typename CacheMap::iterator CacheMapIter;
-	CacheMap map;
+
+	//! A part of the cache with its own lock. Everything but the
+	//! constructor must be called with mutex held.
+	struct Shard
+	{
+		Shard();
+
+		//! The entry for name, or NULL. If slot isn't NO_SLOT, it is
+		//! the index of name's ResourceId, and is tried first.
+		CacheEntry* find(const std::string& name, size_t slot);
+
+		//! The resource, or T() on a miss.
+		T get(const std::string& name, size_t slot, time_t lastUsed);
+		void put(const std::string& name, size_t slot, T data,
+		         size_t bytes, time_t lastUsed);
+		void setLastUsed(CacheEntry& entry, time_t lastUsed);
+		void setEvictable(CacheEntry& entry, bool evictable);
+		void touch(CacheEntry& entry);
+		void erase(CacheEntry& entry);
+		CacheEntry* findEvictable();
+		void collect(time_t now);
+
+		//! The cache this is part of, for accounting.
+		Cache* owner;
+
+		std::mutex mutex;
+
+		CacheMap map;
+
+		//! Entries by the index of the ResourceId they were found by.
+		std::vector<CacheEntry*> slots;
+
+		//! Every entry, least recently used first.
+		EntryList lru;
+
+		//! Entries no one held when last looked at, in the order they
+		//! were last used. The front expires first.
+		EntryList expiring;
+
+		//! Entries the sweep found no one holds, in the order it
+		//! found them, which is close to least recently used first.
+		//! Handing an entry out takes it off, so everything here can
+		//! be evicted.
+		EntryList evictable;
+
+		//! Where in lru the next collect() continues looking for
+		//! entries no one holds anymore.
+		typename EntryList::iterator sweep;
+
+		//! Resources being made by a load, by name.
+		std::map<std::string, std::shared_future<T>> loading;
+	};
+
+	Shard& shardOf(size_t hash);
+
+	T request(const std::string& name, time_t lastUsed);
+	void put(const std::string& name, T data, size_t bytes,
+	         time_t lastUsed);
+	template<class Gen>
+	T load(const std::string& name, size_t hash, size_t slot, Gen gen,
+	       time_t lastUsed);
+
+	//! Run gen, counting it as loading and timing it.
+	template<class Gen>
+	T generate(Gen gen, size_t* bytes);
+
+	//! The shard whose first evictable entry is the oldest, or NULL.
+	Shard* oldestShard(unsigned long* tick);
+
+	Shard shards[CACHE_SHARDS];
+
+	//! The shard the next garbageCollect() works on.
+	std::atomic<size_t> gcShard;
 };
 
 #endif
@@ -34,8 +34,7 @@ Character::Character()
 	: nowalkFlags(TILE_NOWALK | TILE_NOWALK_NPC),
 	  nowalkExempt(0),
 	  fromCoord(0.0, 0.0, 0.0),
-	  fromTile(NULL),
-	  destTile(NULL),
+	  destPhys(0, 0, 0),
 	  destExit(NULL)
 {
 	enterTile();
@@ -82,7 +81,7 @@ vicoord Character::getTileCoords_vi() const
 void Character::setTileCoords(int x, int y)
 {
 	leaveTile();
-	redraw = true;
+	requestRedraw();
 	r = area->virt2virt(vicoord(x, y, r.z));
 	enterTile();
 }
@@ -90,7 +89,7 @@ void Character::setTileCoords(int x, int y)
 void Character::setTileCoords(int x, int y, double z)
 {
 	leaveTile();
-	redraw = true;
+	requestRedraw();
 	r = area->virt2virt(vicoord(x, y, z));
 	enterTile();
 }
@@ -98,7 +97,7 @@ void Character::setTileCoords(int x, int y, double z)
 void Character::setTileCoords(icoord phys)
 {
 	leaveTile();
-	redraw = true;
+	requestRedraw();
 	r = area->phys2virt_r(phys);
 	enterTile();
 }
@@ -106,7 +105,7 @@ void Character::setTileCoords(icoord phys)
 void Character::setTileCoords(vicoord virt)
 {
 	leaveTile();
-	redraw = true;
+	requestRedraw();
 	r = area->virt2virt(virt);
 	enterTile();
 }
@@ -114,7 +113,7 @@ void Character::setTileCoords(vicoord virt)
 void Character::setTileCoords(rcoord virt)
 {
 	leaveTile();
-	redraw = true;
+	requestRedraw();
 	r = virt;
 	enterTile();
 }
@@ -124,11 +123,6 @@ const Tile* Character::getTile() const
 	return area ? area->getTile(r) : NULL;
 }
 
-Tile* Character::getTile()
-{
-	return area ? area->getTile(r) : NULL;
-}
-
 void Character::setArea(Area* area)
 {
 	leaveTile();
@@ -143,17 +137,17 @@ void Character::moveByTile(ivec2 delta)
 
 	setFacing(delta);
 
-	icoord dest = moveDest(facing);
+	// Look up our layer once and work in physical coordinates from here
+	// on.
+	icoord from = getTileCoords_i();
+	icoord dest = area->moveDest(from, facing);
 
-	fromTile = getTile();
-	destTile = area->getTile(dest);
+	destPhys = dest;
 	setDestinationCoordinate(area->phys2virt_r(dest));
 
-	destExit = NULL;
-	if (fromTile && fromTile->exitAt(delta))
-		destExit = fromTile->exitAt(delta);
-	else if (destTile && destTile->exits[EXIT_NORMAL])
-		destExit = destTile->exits[EXIT_NORMAL];
+	destExit = area->exitAt(from, delta);
+	if (!destExit)
+		destExit = area->exitAt(dest, ivec2(0, 0));
 
 	if (!canMove(dest)) {
 		setAnimationStanding();
@@ -165,19 +159,18 @@ void Character::moveByTile(ivec2 delta)
 
 	// Process triggers.
 	runTileExitScript();
-	if (fromTile)
-		fromTile->runLeaveScript(this);
+	area->runLeaveScript(from, this);
 
 	// Modify tile's entity count.
-	leaveTile(fromTile);
-	enterTile(destTile);
+	area->leaveTile(from);
+	area->enterTile(dest);
 
 	Sounds::instance().play(soundPaths["step"]);
 
 	switch (conf.moveMode) {
 	case TURN:
 		// Movement is instantaneous.
-		redraw = true;
+		requestRedraw();
 		r = destCoord;
 		moving = false;
 		setAnimationStanding();
@@ -193,14 +186,10 @@ void Character::moveByTile(ivec2 delta)
 
 icoord Character::moveDest(ivec2 facing)
 {
-	Tile* tile = getTile();
 	icoord here = getTileCoords_i();
 
-	if (tile)
-		// Handle layermod.
-		return tile->moveDest(here, facing);
-	else
-		return here + icoord(facing.x, facing.y, 0);
+	// Handle layermod.
+	return area->moveDest(here, facing);
 }
 
 bool Character::canMove(icoord dest)
@@ -212,12 +201,11 @@ bool Character::canMove(icoord dest)
 			return true;
 	}
 
-	bool inBounds = area->inBounds(dest);
-	if (destTile && inBounds) {
+	if (area->inBounds(dest)) {
 		// Tile is inside map. Can we move?
-		if (nowalked(*destTile))
+		if (nowalked(dest))
 			return false;
-		if (destTile->entCnt)
+		if (area->occupied(dest))
 			// Space is occupied by another Entity.
 			return false;
 
@@ -228,26 +216,28 @@ bool Character::canMove(icoord dest)
 	return nowalkExempt & TILE_NOWALK_AREA_BOUND;
 }
 
-bool Character::nowalked(Tile& t)
+bool Character::nowalked(icoord phys)
 {
 	unsigned flags = nowalkFlags & ~nowalkExempt;
-	return t.hasFlag(flags);
+	return area->hasFlag(phys, flags);
 }
 
 void Character::arrived()
 {
 	Entity::arrived();
 
-	if (destTile) {
-		double* layermod = destTile->layermods[EXIT_NORMAL];
+	bool inBounds = area->inBounds(destPhys);
+	if (inBounds) {
+		const double* layermod = area->layermodAt(destPhys,
+		                                          ivec2(0, 0));
 		if (layermod) {
 			r.z = *layermod;
 		}
 	}
 
 	// Process triggers.
-	if (destTile)
-		destTile->runEnterScript(this);
+	if (inBounds)
+		area->runEnterScript(destPhys, this);
 
 	runTileEntryScript();
 
@@ -264,25 +254,14 @@ void Character::arrived()
 
 void Character::leaveTile()
 {
-	leaveTile(getTile());
-	
-}
-
-void Character::leaveTile(Tile* t)
-{
-	if (t)
-		t->entCnt--;
+	if (area)
+		area->leaveTile(area->virt2phys(r));
 }
 
 void Character::enterTile()
 {
-	enterTile(getTile());
-}
-
-void Character::enterTile(Tile* t)
-{
-	if (t)
-		t->entCnt++;
+	if (area)
+		area->enterTile(area->virt2phys(r));
 }
 
 void Character::runTileExitScript()
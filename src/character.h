@@ -57,9 +57,8 @@ public:
 	void setTileCoords(vicoord virt);
 	void setTileCoords(rcoord virt);
 
-	//! Get the Tile that we are standing on.
+	//! Get the Tile that we are standing on, or NULL if it is empty.
 	const Tile* getTile() const;
-	Tile* getTile();
 
 	void setArea(Area* area);
 
@@ -74,14 +73,12 @@ protected:
 	//! Returns true if we can move in the desired direction.
 	bool canMove(icoord dest);
 
-	bool nowalked(Tile& t);
+	bool nowalked(icoord phys);
 
 	void arrived();
 
 	void leaveTile();
-	void leaveTile(Tile* t);
 	void enterTile();
-	void enterTile(Tile* t);
 
 	void runTileExitScript();
 	void runTileEntryScript();
@@ -91,9 +88,8 @@ protected:
 	unsigned nowalkExempt;
 
 	rcoord fromCoord;
-	Tile* fromTile;
-	Tile* destTile;
-	Exit* destExit;
+	icoord destPhys;
+	const Exit* destExit;
 };
 
 #endif
@@ -43,6 +43,12 @@ Conf::Conf()
 {
 	persistInit = 0;
 	persistCons = 0;
+	sparseLayers = DEF_ENGINE_SPARSE_LAYERS;
+	streamTMX = DEF_ENGINE_STREAM_TMX;
+	validationCache = DEF_CACHE_VALIDATION;
+	decodedCache = DEF_CACHE_DECODED;
+	areaMemory = DEF_CACHE_AREA_MEMORY;
+	cacheSize = DEF_CACHE_SIZE;
 }
 
 bool Conf::validate(const std::string& filename)
@@ -59,6 +65,10 @@ static void defaultsQuery()
 		<< DEF_ENGINE_VERBOSITY << std::endl;
 	std::cerr << "DEF_ENGINE_HALTING:                  "
 		<< DEF_ENGINE_HALTING << std::endl;
+	std::cerr << "DEF_ENGINE_SPARSE_LAYERS:            "
+		<< DEF_ENGINE_SPARSE_LAYERS << std::endl;
+	std::cerr << "DEF_ENGINE_STREAM_TMX:               "
+		<< DEF_ENGINE_STREAM_TMX << std::endl;
 	std::cerr << "DEF_WINDOW_WIDTH:                    "
 		<< DEF_WINDOW_WIDTH << std::endl;
 	std::cerr << "DEF_WINDOW_HEIGHT:                   "
@@ -69,6 +79,14 @@ static void defaultsQuery()
 		<< DEF_CACHE_ENABLED << std::endl;
 	std::cerr << "DEF_CACHE_TTL:                       "
 		<< DEF_CACHE_TTL << std::endl;
+	std::cerr << "DEF_CACHE_VALIDATION:                "
+		<< DEF_CACHE_VALIDATION << std::endl;
+	std::cerr << "DEF_CACHE_AREA_MEMORY:               "
+		<< DEF_CACHE_AREA_MEMORY << std::endl;
+	std::cerr << "DEF_CACHE_SIZE:                      "
+		<< DEF_CACHE_SIZE << std::endl;
+	std::cerr << "DEF_CACHE_DECODED:                   "
+		<< DEF_CACHE_DECODED << std::endl;
 }
 
 // Parse and process the client config file, and set configuration defaults for
@@ -96,6 +114,12 @@ bool parseConfig(const std::string& filename)
 	conf.windowSize.y = ini.get("window.height", DEF_WINDOW_HEIGHT);
 	conf.fullscreen = ini.get("window.fullscreen", DEF_WINDOW_FULLSCREEN);
 	conf.cacheEnabled = ini.get("cache.enabled", DEF_CACHE_ENABLED);
+	conf.validationCache = ini.get("cache.validation",
+	                               DEF_CACHE_VALIDATION);
+	conf.decodedCache = ini.get("cache.decoded", DEF_CACHE_DECODED);
+	conf.sparseLayers = ini.get("engine.sparselayers",
+	                            DEF_ENGINE_SPARSE_LAYERS);
+	conf.streamTMX = ini.get("engine.streamtmx", DEF_ENGINE_STREAM_TMX);
 
 	conf.musicVolume = ini.get("audio.musicvolume", 100);
 	if (conf.musicVolume < 0)
@@ -113,6 +137,14 @@ bool parseConfig(const std::string& filename)
 	if (!conf.cacheTTL)
 		conf.cacheEnabled = false;
 
+	conf.areaMemory = ini.get("cache.areamemory", DEF_CACHE_AREA_MEMORY);
+	if (conf.areaMemory < 0)
+		conf.areaMemory = 0;
+
+	conf.cacheSize = ini.get("cache.size", DEF_CACHE_SIZE);
+	if (conf.cacheSize < 0)
+		conf.cacheSize = 0;
+
 	std::string verbosity = ini.get("engine.verbosity", DEF_ENGINE_VERBOSITY);
 	if (verbosity.empty())
 		;
@@ -168,6 +200,7 @@ bool parseCommandLine(int argc, char* argv[])
 	cmd.insert("",   "--no-audio",     "",                "Disable audio");
 	cmd.insert("",   "--volume-music", "<0-100>",         "Set music volume");
 	cmd.insert("",   "--volume-sound", "<0-100>",         "Set sound effects volume");
+	cmd.insert("",   "--compile-area", "<file,file,...>", "Compile areas for faster loading and exit");
 	cmd.insert("",   "--query",        "",                "Query compiled-in engine defaults");
 	cmd.insert("",   "--version",      "",                "Print the engine version string");
 	
@@ -240,6 +273,9 @@ bool parseCommandLine(int argc, char* argv[])
 			conf.cacheEnabled = false;
 	}
 
+	if (cmd.check("--cache-size"))
+		conf.cacheSize = parseUInt(cmd.get("--cache-size"));
+
 	if (cmd.check("--size")) {
 		std::vector<std::string> dim = splitStr(cmd.get("--size"), "x");
 		if (dim.size() != 2) {
@@ -261,6 +297,9 @@ bool parseCommandLine(int argc, char* argv[])
 	if (cmd.check("--window"))
 		conf.fullscreen = false;
 
+	if (cmd.check("--compile-area"))
+		conf.compileAreas = splitStr(cmd.get("--compile-area"), ",");
+
 	return true;
 }
 
@@ -28,6 +28,7 @@
 #define CLIENT_CONF_H
 
 #include <string>
+#include <vector>
 #include "log.h"
 #include "vec.h"
 
@@ -37,16 +38,31 @@
 // === Required Data Paths ===
 	/* Tsunagari config file. */
 	#define CLIENT_CONF_PATH "./client.ini"
+
+	/* Hashes of documents that passed DTD validation. */
+	#define VALIDATION_CACHE_PATH "./validated.cache"
+
+	/* Where cache statistics are written when asked for with SIGUSR1. */
+	#define CACHE_STATS_PATH "./cache-stats.json"
+
+	/* Decoded images kept between runs. */
+	#define DECODED_CACHE_PATH "./decoded-cache"
 // ===
 
 // === Client.ini Default Values ===
 	#define DEF_ENGINE_VERBOSITY  "verbose"
 	#define DEF_ENGINE_HALTING    "fatal"
+	#define DEF_ENGINE_SPARSE_LAYERS false
+	#define DEF_ENGINE_STREAM_TMX false
 	#define DEF_WINDOW_WIDTH      640
 	#define DEF_WINDOW_HEIGHT     480
 	#define DEF_WINDOW_FULLSCREEN false
 	#define DEF_CACHE_ENABLED     true
 	#define DEF_CACHE_TTL         300
+	#define DEF_CACHE_VALIDATION  false
+	#define DEF_CACHE_AREA_MEMORY 0
+	#define DEF_CACHE_SIZE        0
+	#define DEF_CACHE_DECODED     false
 // ===
 
 //! Game Movement Mode
@@ -75,14 +91,23 @@ struct Conf {
 	verbosity_t verbosity;
 	movement_mode_t moveMode;
 	halting_mode_t halting;
+	bool sparseLayers;
+	bool streamTMX;
 	icoord windowSize;
 	bool fullscreen;
 	int musicVolume;
 	int soundVolume;
 	bool cacheEnabled;
 	int cacheTTL;
+	int cacheSize;
+	bool validationCache;
+	bool decodedCache;
+	int areaMemory;
 	int persistInit;
 	int persistCons;
+
+	//! Areas to compile with --compile-area instead of running the game.
+	std::vector<std::string> compileAreas;
 };
 extern Conf conf;
 
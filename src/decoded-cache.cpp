@@ -0,0 +1,280 @@
+/**********************************
+** Tsunagari Tile Engine         **
+** decoded-cache.cpp             **
+** Copyright 2015 PariahSoft LLC **
+**********************************/
+
+// **********
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+// **********
+
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <fstream>
+
+#ifdef _WIN32
+	#include <direct.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <unistd.h>
+#endif
+
+#include "client-conf.h"
+#include "decoded-cache.h"
+#include "formatter.h"
+#include "log.h"
+#include "validation-cache.h"
+
+#include "data/data-world.h"
+
+//! Part of every key. Change it if the file format changes.
+#define DECODED_CACHE_VERSION "tsunagari-decoded-cache 1"
+
+//! Identifies the world archive the cache was filled from.
+#define STAMP_PATH DECODED_CACHE_PATH "/world"
+
+//! Names of the files written to the cache, one per line.
+#define INDEX_PATH DECODED_CACHE_PATH "/index"
+
+//! Starts every cache file, followed by width * height pixels.
+struct DecodedHeader
+{
+	char magic[8];
+	uint32_t width;
+	uint32_t height;
+};
+
+static const char DECODED_MAGIC[8] = "tsudec1";
+
+static bool validHeader(const DecodedHeader& header, size_t fileSize)
+{
+	return memcmp(header.magic, DECODED_MAGIC, sizeof(DECODED_MAGIC)) == 0 &&
+	       fileSize == sizeof(DecodedHeader) +
+	                   (size_t)header.width * header.height * 4;
+}
+
+//! The world archive's path, size and modification time.
+static std::string archiveStamp()
+{
+	const std::string& path = DataWorld::instance().datafile;
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0)
+		return path;
+	return Formatter("% % %") % path % (unsigned long)st.st_size %
+		(long)st.st_mtime;
+}
+
+
+DecodedBitmap::DecodedBitmap()
+	: w(0), h(0), px(NULL), map(NULL), mapSize(0)
+{
+}
+
+DecodedBitmap::~DecodedBitmap()
+{
+#ifndef _WIN32
+	if (map)
+		munmap(map, mapSize);
+#endif
+}
+
+unsigned DecodedBitmap::width() const
+{
+	return w;
+}
+
+unsigned DecodedBitmap::height() const
+{
+	return h;
+}
+
+const uint32_t* DecodedBitmap::pixels() const
+{
+	return px;
+}
+
+
+static DecodedCache globalDecodedCache;
+
+DecodedCache& DecodedCache::instance()
+{
+	return globalDecodedCache;
+}
+
+DecodedCache::DecodedCache()
+	: ready(false)
+{
+}
+
+uint64_t DecodedCache::key(const void* data, size_t size)
+{
+	return ValidationCache::hash(data, size,
+		ValidationCache::hash(DECODED_CACHE_VERSION));
+}
+
+std::unique_ptr<DecodedBitmap> DecodedCache::load(uint64_t key)
+{
+	std::call_once(initialized, [this] { init(); });
+	if (!ready)
+		return NULL;
+
+	std::string path = DECODED_CACHE_PATH "/" + filename(key);
+	std::unique_ptr<DecodedBitmap> bitmap(new DecodedBitmap);
+
+#ifndef _WIN32
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	struct stat st;
+	if (fstat(fd, &st) != 0 ||
+	    (size_t)st.st_size < sizeof(DecodedHeader)) {
+		close(fd);
+		return NULL;
+	}
+	size_t size = (size_t)st.st_size;
+	void* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return NULL;
+	bitmap->map = map;
+	bitmap->mapSize = size;
+
+	const DecodedHeader& header = *(const DecodedHeader*)map;
+	if (!validHeader(header, size)) {
+		Log::err(path, "corrupt decoded image");
+		return NULL;
+	}
+	bitmap->px = (const uint32_t*)((const char*)map +
+	                               sizeof(DecodedHeader));
+#else
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file)
+		return NULL;
+	size_t size = (size_t)file.tellg();
+	file.seekg(0);
+	DecodedHeader header;
+	if (!file.read((char*)&header, sizeof(header)) ||
+	    !validHeader(header, size)) {
+		Log::err(path, "corrupt decoded image");
+		return NULL;
+	}
+	bitmap->copy.resize((size_t)header.width * header.height);
+	file.read((char*)bitmap->copy.data(), bitmap->copy.size() * 4);
+	if (!file)
+		return NULL;
+	bitmap->px = bitmap->copy.data();
+#endif
+
+	bitmap->w = header.width;
+	bitmap->h = header.height;
+	return bitmap;
+}
+
+void DecodedCache::store(uint64_t key, unsigned width, unsigned height,
+                         const uint32_t* pixels)
+{
+	std::call_once(initialized, [this] { init(); });
+	if (!ready)
+		return;
+
+	std::string name = filename(key);
+	std::string path = DECODED_CACHE_PATH "/" + name;
+	std::string tmp = path + ".tmp";
+
+	DecodedHeader header;
+	memcpy(header.magic, DECODED_MAGIC, sizeof(DECODED_MAGIC));
+	header.width = width;
+	header.height = height;
+
+	{
+		std::ofstream file(tmp, std::ios::binary);
+		file.write((const char*)&header, sizeof(header));
+		file.write((const char*)pixels, (size_t)width * height * 4);
+		if (!file) {
+			Log::err(tmp, "could not write decoded image");
+			file.close();
+			remove(tmp.c_str());
+			return;
+		}
+	}
+
+	// Write under another name first so a half-written file is never
+	// mistaken for a whole one.
+	if (rename(tmp.c_str(), path.c_str()) != 0) {
+		remove(tmp.c_str());
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(indexMutex);
+	std::ofstream index(INDEX_PATH, std::ios::app);
+	index << name << std::endl;
+}
+
+void DecodedCache::init()
+{
+#ifdef _WIN32
+	int made = _mkdir(DECODED_CACHE_PATH);
+#else
+	int made = mkdir(DECODED_CACHE_PATH, 0755);
+#endif
+	if (made != 0 && errno != EEXIST) {
+		Log::err(DECODED_CACHE_PATH, "could not create directory");
+		return;
+	}
+
+	std::string stamp = archiveStamp();
+	std::string old;
+	{
+		std::ifstream file(STAMP_PATH);
+		std::getline(file, old);
+	}
+
+	// Keys are content hashes, so entries from another archive are never
+	// returned by mistake. Clear them out anyway so the cache doesn't grow
+	// without bound as the world changes.
+	if (old != stamp) {
+		std::ifstream index(INDEX_PATH);
+		std::string name;
+		while (std::getline(index, name))
+			if (!name.empty())
+				remove((DECODED_CACHE_PATH "/" + name).c_str());
+		index.close();
+
+		std::ofstream(INDEX_PATH, std::ios::trunc);
+		std::ofstream file(STAMP_PATH, std::ios::trunc);
+		file << stamp << std::endl;
+		if (!old.empty())
+			Log::info("DecodedCache", "world changed, emptied cache");
+	}
+
+	ready = true;
+}
+
+std::string DecodedCache::filename(uint64_t key) const
+{
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%016llx.rgba", (unsigned long long)key);
+	return buf;
+}
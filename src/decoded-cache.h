@@ -0,0 +1,115 @@
+/**********************************
+** Tsunagari Tile Engine         **
+** decoded-cache.h               **
+** Copyright 2015 PariahSoft LLC **
+**********************************/
+
+// **********
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+// **********
+
+
+#ifndef DECODED_CACHE_H
+#define DECODED_CACHE_H
+
+#include <stdint.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//! An image read back from the DecodedCache as 32-bit pixels, row by row.
+/*!
+	Where the platform allows, the pixels are mapped straight from the
+	cache file rather than read into memory.
+*/
+class DecodedBitmap
+{
+public:
+	~DecodedBitmap();
+
+	unsigned width() const;
+	unsigned height() const;
+	const uint32_t* pixels() const;
+
+private:
+	friend class DecodedCache;
+
+	DecodedBitmap();
+	DecodedBitmap(const DecodedBitmap&) = delete;
+	DecodedBitmap& operator=(const DecodedBitmap&) = delete;
+
+	unsigned w, h;
+	const uint32_t* px;
+
+	//! The whole file if it is mapped, for unmapping.
+	void* map;
+	size_t mapSize;
+
+	//! The pixels if they were read instead.
+	std::vector<uint32_t> copy;
+};
+
+/**
+ * Keeps decoded images on disk in DECODED_CACHE_PATH, keyed by a hash of
+ * the file they were decoded from, so later runs can skip decoding them.
+ * The cache is emptied whenever the world archive changes.
+ *
+ * Only used if enabled in client.ini.
+ */
+class DecodedCache
+{
+public:
+	//! Acquire the global DecodedCache object.
+	static DecodedCache& instance();
+
+	DecodedCache();
+
+	//! Key for a source file's content.
+	static uint64_t key(const void* data, size_t size);
+
+	//! The image decoded from the source with this key, or NULL if we
+	//! don't have it.
+	std::unique_ptr<DecodedBitmap> load(uint64_t key);
+
+	//! Keep an image decoded from the source with this key.
+	void store(uint64_t key, unsigned width, unsigned height,
+	           const uint32_t* pixels);
+
+private:
+	DecodedCache(const DecodedCache&) = delete;
+	DecodedCache& operator=(const DecodedCache&) = delete;
+
+	//! Create the cache directory, and empty it if the world archive is
+	//! not the one it was filled from.
+	void init();
+
+	std::string filename(uint64_t key) const;
+
+	std::once_flag initialized;
+
+	//! Whether the directory is usable.
+	bool ready;
+
+	//! Guards appending to the index of files written.
+	std::mutex indexMutex;
+};
+
+#endif
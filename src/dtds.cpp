@@ -374,7 +374,15 @@ R"(<?xml version="1.0" encoding="utf-8"?>
   height      CDATA   #IMPLIED
 >
 
-<!ELEMENT data (tile)*>
+<!-- 
+  tile children are only used when there is no encoding
+  compression is only valid with base64 encoding
+-->
+<!ELEMENT data (#PCDATA | tile)*>
+<!ATTLIST data
+  encoding    (csv | base64)  #IMPLIED
+  compression (zlib | gzip)   #IMPLIED
+>
 
 <!ELEMENT tileset (image*, tile*)>
 <!--
@@ -56,6 +56,8 @@ Entity::Entity()
 	  speedMul(1.0),
 	  moving(false),
 	  phase(NULL),
+	  phaseDeadline(0),
+	  drawnRect(0, 0, 0, 0, 0, 0),
 	  phaseName(""),
 	  facing(0, 0)
 {
@@ -84,11 +86,15 @@ void Entity::destroy()
 void Entity::draw()
 {
 	redraw = false;
-	if (!phase)
+	drawnRect = pixels();
+	if (!phase) {
+		phaseDeadline = ANIM_NO_FRAME_CHANGE;
 		return;
+	}
 
 	time_t now = World::instance().time();
 	Image* img = phase->frame(now);
+	phaseDeadline = phase->nextFrameChange(now);
 
 	img->draw(
 		doff.x + r.x,
@@ -97,21 +103,40 @@ void Entity::draw()
 	);
 }
 
-bool Entity::needsRedraw(const icube& visiblePixels) const
+bool Entity::onScreen(const icube& visiblePixels) const
 {
-	time_t now = World::instance().time();
+	auto overlaps = [&] (const icube& rect) {
+		return rect.x1 <= visiblePixels.x2 &&
+		       visiblePixels.x1 <= rect.x2 &&
+		       rect.y1 <= visiblePixels.y2 &&
+		       visiblePixels.y1 <= rect.y2;
+	};
+	return overlaps(pixels()) || overlaps(drawnRect);
+}
 
-	// Don't need to redraw
-	if (!redraw && (!phase || !phase->needsRedraw(now)))
-		return false;
+time_t Entity::nextFrameChange() const
+{
+	return phaseDeadline;
+}
 
-	// Aren't on-screen
-	if (visiblePixels.x2 < r.x || r.x + imgsz.x < visiblePixels.x1)
-		return false;
-	if (visiblePixels.y2 < r.y || r.y + imgsz.y < visiblePixels.y1)
-		return false;
+bool Entity::isDirty(time_t now) const
+{
+	return redraw || now >= phaseDeadline;
+}
 
-	return true;
+icube Entity::drawnPixels() const
+{
+	return drawnRect;
+}
+
+icube Entity::pixels() const
+{
+	double x = doff.x + r.x;
+	double y = doff.y + r.y;
+	return icube(
+		(int)floor(x), (int)floor(y), 0,
+		(int)ceil(x + imgsz.x), (int)ceil(y + imgsz.y), 0
+	);
 }
 
 bool Entity::isDead() const
@@ -277,7 +302,7 @@ enum SetPhaseResult Entity::_setPhase(const std::string& name)
 		phase = newPhase;
 		phase->startOver(now, ANIM_INFINITE_CYCLES);
 		phaseName = name;
-		redraw = true;
+		requestRedraw();
 		return PHASE_CHANGED;
 	}
 	return PHASE_NOTCHANGED;
@@ -293,12 +318,19 @@ void Entity::setDestinationCoordinate(rcoord destCoord)
 	angleToDest = atan2(destCoord.y - r.y, destCoord.x - r.x);
 }
 
+void Entity::requestRedraw()
+{
+	redraw = true;
+	if (area)
+		area->entityChanged(*this);
+}
+
 void Entity::moveTowardDestination(time_t dt)
 {
 	if (!moving)
 		return;
 
-	redraw = true;
+	requestRedraw();
 
 	double traveledPixels = speed * (double)dt;
 	double toDestPixels = r.distanceTo(destCoord);
@@ -469,7 +501,7 @@ bool Entity::processSound(const XMLNode node)
 		return false;
 	}
 
-	soundPaths[name] = filename;
+	soundPaths[name] = ResourceId(filename);
 	return true;
 }
 
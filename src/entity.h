@@ -32,6 +32,7 @@
 #include <string>
 #include <vector>
 
+#include "resource-id.h"
 #include "vec.h"
 #include "xmls.h"
 
@@ -73,7 +74,22 @@ public:
 	virtual void destroy();
 
 	void draw();
-	bool needsRedraw(const icube& visiblePixels) const;
+
+	//! True if we cover any of the pixels now or did in the last draw().
+	//! Only the x and y components are used.
+	bool onScreen(const icube& visiblePixels) const;
+
+	//! Time at which our phase will next change frames, as of the last
+	//! draw().
+	time_t nextFrameChange() const;
+
+	//! True if we have moved or changed frames since the last draw().
+	bool isDirty(time_t now) const;
+
+	//! Pixels we covered in the last draw(), and those we would cover
+	//! if drawn now. Only the x and y components are used.
+	icube drawnPixels() const;
+	icube pixels() const;
 	bool isDead() const;
 
 	virtual void tick(time_t dt);
@@ -158,6 +174,10 @@ protected:
 	//! Entity’s graphics will appear as if it never stopped moving.
 	virtual void arrived();
 
+	//! Note that we moved or changed how we look, so that our Area can
+	//! redraw.
+	void requestRedraw();
+
 	// XML parsing functions used in constructing an Entity
 	bool processDescriptor();
 	bool processSprite(XMLNode node);
@@ -185,7 +205,8 @@ protected:
 	//! Set to true if the Entity was destroyed this tick.
 	bool dead;
 
-	//! Set to true if the Entity wants the screen to be redrawn.
+	//! Set to true if the Entity wants the screen to be redrawn. See
+	//! requestRedraw().
 	bool redraw;
 
 	//! Pointer to Area this Entity is located on.
@@ -210,12 +231,14 @@ protected:
 	ivec2 imgsz;
 	AnimationMap phases;
 	Animation* phase;
+	time_t phaseDeadline; //!< See nextFrameChange().
+	icube drawnRect; //!< See drawnPixels().
 	std::string phaseName;
 	ivec2 facing;
 
-	//! Map from effect name to filenames.
+	//! Map from effect name to filenames, interned when read.
 	//!  e.g.: ["step"] = "sounds/player_step.oga"
-	std::map<std::string, std::string> soundPaths;
+	std::map<std::string, ResourceId> soundPaths;
 
 	std::vector<OnTickFn> onTickFns;
 	std::vector<OnTurnFn> onTurnFns;
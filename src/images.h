@@ -30,6 +30,14 @@
 #include <memory>
 #include <string>
 
+//! How much of what lies beneath an Image it hides.
+enum Opacity {
+	OPACITY_UNKNOWN,     //!< Not classified. Treat as partial.
+	OPACITY_OPAQUE,      //!< Every pixel is fully opaque.
+	OPACITY_TRANSPARENT, //!< Every pixel is fully transparent.
+	OPACITY_PARTIAL      //!< Anything else.
+};
+
 class Image
 {
 public:
@@ -42,6 +50,7 @@ public:
 
 	virtual unsigned width() const = 0;
 	virtual unsigned height() const = 0;
+	virtual Opacity opacity() const = 0;
 
 protected:
 	Image() = default;
@@ -86,6 +95,15 @@ public:
 	virtual std::shared_ptr<TiledImage> loadTiles(const std::string& path,
 		unsigned tileW, unsigned tileH) = 0;
 
+	//! Capture everything drawn until endRecording() into a new Image
+	//! instead of drawing it to the screen. Drawing the result costs
+	//! about as much as drawing a single Image. Returns false if
+	//! recording is not supported, in which case endRecording() must not
+	//! be called.
+	virtual bool beginRecording() = 0;
+	virtual std::shared_ptr<Image> endRecording(unsigned width,
+		unsigned height) = 0;
+
 	//! Free images not recently used.
 	virtual void garbageCollect() = 0;
 
@@ -43,6 +43,8 @@ static verbosity_t verb = V_NORMAL;
 
 static time_t startTime;
 
+static thread_local bool muted = false;
+
 static std::string& chomp(std::string& str)
 {
 	std::string::size_type notwhite = str.find_last_not_of(" \t\n\r");
@@ -72,8 +74,15 @@ void Log::setVerbosity(verbosity_t v)
 	verb = v;
 }
 
+void Log::muteThread(bool mute)
+{
+	muted = mute;
+}
+
 void Log::info(std::string domain, std::string msg)
 {
+	if (muted)
+		return;
 	std::string str = ts() + "Info [" + domain + "] - " + chomp(msg);
 	if (verb > V_NORMAL)
 		std::cout << str << std::endl;
@@ -81,6 +90,8 @@ void Log::info(std::string domain, std::string msg)
 
 void Log::err(std::string domain, std::string msg)
 {
+	if (muted)
+		return;
 	if (conf.halting == HALT_ERROR) {
 		Log::fatal(domain, msg);
 	}
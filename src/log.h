@@ -49,6 +49,12 @@ public:
 	 */
 	static void setVerbosity(verbosity_t mode);
 
+	/**
+	 * Suppress info and error messages logged from the calling thread.
+	 * Used by background work that is redone if it fails.
+	 */
+	static void muteThread(bool mute);
+
 	/**
 	 * Log an info message to the console if verbosity is "V_VERBOSE".
 	 */
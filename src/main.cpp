@@ -24,16 +24,21 @@
 // IN THE SOFTWARE.
 // **********
 
+#include <signal.h>
 #include <stdlib.h>
 #include <time.h>
 
 #include <libxml/parser.h>
 #include <physfs.h>
 
+#include "area-binary.h"
+#include "area-prefetch.h"
+#include "cache.h"
 #include "client-conf.h"
 #include "formatter.h"
 #include "log.h"
 #include "resources.h"
+#include "validation-cache.h"
 #include "window.h"
 #include "world.h"
 
@@ -47,6 +52,14 @@
   #include "os-mac.h"
 #endif
 
+#ifndef _WIN32
+//! Write cache statistics to CACHE_STATS_PATH on SIGUSR1.
+static void requestCacheStats(int)
+{
+	CacheBase::requestDump();
+}
+#endif
+
 /**
  * Load client config and instantiate window.
  *
@@ -82,12 +95,26 @@ int main(int argc, char** argv)
 	Log::info("Main", Formatter("Starting %") % TSUNAGARI_RELEASE_VERSION);
 	Log::reportVerbosityOnStartup();
 
+#ifndef _WIN32
+	signal(SIGUSR1, requestCacheStats);
+#endif
+
 	/* This initializes the XML library and checks for potential
 	 * ABI mismatches between the version it was compiled for and
 	 * the actual shared library used.
 	 */
 	LIBXML_TEST_VERSION
 
+	// Compiling areas only needs the world's data, not a window.
+	if (conf.compileAreas.size()) {
+		bool ok = true;
+		for (auto& area : conf.compileAreas)
+			ok = compileArea(area) && ok;
+		PHYSFS_deinit();
+		xmlCleanupParser();
+		return ok ? 0 : 1;
+	}
+
 	GameWindow* window = GameWindow::create();
 	World& world = World::instance();
 	DataWorld& dataWorld = DataWorld::instance();
@@ -110,8 +137,15 @@ int main(int argc, char** argv)
 	window->mainLoop();
 
 	// Cleanup
+	AreaPrefetcher::instance().stop();
 	delete window;
 
+	world.reportGCPauses();
+	CacheBase::reportStats();
+
+	if (conf.validationCache)
+		ValidationCache::instance().reportStats();
+
 	PHYSFS_deinit();
 
 	xmlCleanupParser();
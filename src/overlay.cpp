@@ -45,7 +45,7 @@ void Overlay::tick(time_t dt)
 void Overlay::teleport(vicoord coord)
 {
 	r = area->virt2virt(coord);
-	redraw = true;
+	requestRedraw();
 }
 
 void Overlay::drift(ivec2 xy)
@@ -113,7 +113,7 @@ void Player::moveByTile(ivec2 delta)
 	// --pdm Dec 6, 2014
 	if (GameWindow::instance().isKeyDown(KBLeftControl)) {
 		setAnimationStanding();
-		redraw = true;
+		requestRedraw();
 		return;
 	}
 
@@ -124,9 +124,7 @@ void Player::moveByTile(ivec2 delta)
 
 void Player::useTile()
 {
-	Tile* t = area->getTile(moveDest(facing));
-	if (t)
-		t->runUseScript(this);
+	area->runUseScript(moveDest(facing), this);
 }
 
 void Player::setFrozen(bool b)
@@ -151,7 +149,7 @@ void Player::arrived()
 		moveByTile(velocity);
 }
 
-void Player::takeExit(Exit* exit)
+void Player::takeExit(const Exit* exit)
 {
 	World& world = World::instance();
 	Area* newArea = world.getArea(exit->area);
@@ -33,34 +33,44 @@
 #include "cache.h"
 #include "log.h"
 
+//! A Cache that makes the resources it doesn't have with a GenFn. Safe to
+//! use from several threads, and the GenFn runs on whichever asked first.
 template<class T>
 class ReaderCache
 {
 public:
-	typedef T (*GenFn)(const std::string& name);
+	//! Loads the named resource and says how many bytes holding it costs.
+	typedef T (*GenFn)(const std::string& name, size_t* bytes);
 
-	ReaderCache(GenFn fn) : fn(fn) {}
+	//! Name is what statistics call the cache.
+	ReaderCache(const char* name, GenFn fn) : fn(fn), cache(name) {}
 
 	T momentaryRequest(const std::string& name)
 	{
-		T t = cache.momentaryRequest(name);
-		if (t)
-			return t;
-
-		t = fn(name);
-		cache.momentaryPut(name, t);
-		return t;
+		return cache.momentaryLoad(name, [&](size_t* bytes) {
+			return fn(name, bytes);
+		});
 	}
 
 	T lifetimeRequest(const std::string& name)
 	{
-		T t = cache.lifetimeRequest(name);
-		if (t)
-			return t;
+		return cache.lifetimeLoad(name, [&](size_t* bytes) {
+			return fn(name, bytes);
+		});
+	}
+
+	T momentaryRequest(ResourceId id)
+	{
+		return cache.momentaryLoad(id, [&](size_t* bytes) {
+			return fn(id.path(), bytes);
+		});
+	}
 
-		t = fn(name);
-		cache.lifetimePut(name, t);
-		return t;
+	T lifetimeRequest(ResourceId id)
+	{
+		return cache.lifetimeLoad(id, [&](size_t* bytes) {
+			return fn(id.path(), bytes);
+		});
 	}
 
 	void garbageCollect()
@@ -0,0 +1,97 @@
+/**********************************
+** Tsunagari Tile Engine         **
+** resource-id.cpp               **
+** Copyright 2015 PariahSoft LLC **
+**********************************/
+
+// **********
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+// **********
+
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+
+#include "resource-id.h"
+
+struct InternedPath
+{
+	std::string path;
+	size_t index;
+	size_t hash;
+};
+
+//! Every path interned so far. Entries never move or go away.
+static std::deque<InternedPath> paths;
+static std::unordered_map<std::string, const InternedPath*> byPath;
+static std::mutex internMutex;
+
+static const std::string noPath;
+
+ResourceId::ResourceId()
+	: interned(NULL)
+{
+}
+
+ResourceId::ResourceId(const std::string& path)
+{
+	std::lock_guard<std::mutex> lock(internMutex);
+	auto it = byPath.find(path);
+	if (it != byPath.end()) {
+		interned = it->second;
+		return;
+	}
+	paths.push_back(InternedPath{
+		path, paths.size(), std::hash<std::string>()(path)
+	});
+	interned = &paths.back();
+	byPath[path] = interned;
+}
+
+const std::string& ResourceId::path() const
+{
+	return interned ? interned->path : noPath;
+}
+
+size_t ResourceId::index() const
+{
+	return interned->index;
+}
+
+size_t ResourceId::hash() const
+{
+	return interned->hash;
+}
+
+ResourceId::operator bool() const
+{
+	return interned != NULL;
+}
+
+bool ResourceId::operator==(const ResourceId& other) const
+{
+	return interned == other.interned;
+}
+
+bool ResourceId::operator!=(const ResourceId& other) const
+{
+	return interned != other.interned;
+}
@@ -0,0 +1,72 @@
+/**********************************
+** Tsunagari Tile Engine         **
+** resource-id.h                 **
+** Copyright 2015 PariahSoft LLC **
+**********************************/
+
+// **********
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+// **********
+
+
+#ifndef RESOURCE_ID_H
+#define RESOURCE_ID_H
+
+#include <stddef.h>
+
+#include <string>
+
+struct InternedPath;
+
+//! A resource path interned once, so caches can find it by a dense index
+//! instead of comparing strings on every request.
+/*!
+	Interning the same path always gives an equal ResourceId. Ids are
+	never freed, so intern the paths a descriptor names when it is read,
+	not paths made up on the fly.
+*/
+class ResourceId
+{
+public:
+	//! Refers to no resource.
+	ResourceId();
+
+	//! Intern path. Safe to call from any thread.
+	explicit ResourceId(const std::string& path);
+
+	const std::string& path() const;
+
+	//! Numbered from 0 in the order paths were first interned.
+	size_t index() const;
+
+	//! std::hash of the path, worked out once.
+	size_t hash() const;
+
+	//! Whether this refers to a resource.
+	operator bool() const;
+
+	bool operator==(const ResourceId& other) const;
+	bool operator!=(const ResourceId& other) const;
+
+private:
+	const InternedPath* interned;
+};
+
+#endif
+
@@ -65,6 +65,10 @@ public:
 	//! Returns NULL if the resource does not exist.
 	virtual std::unique_ptr<Resource> load(const std::string& path) = 0;
 
+	//! Whether a resource exists at the given path. Unlike load(), a
+	//! missing resource is not an error.
+	virtual bool exists(const std::string& path) = 0;
+
 protected:
 	Resources() = default;
 
@@ -26,6 +26,15 @@
 
 #include <limits>
 #include <physfs.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifndef _WIN32
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <unistd.h>
+#endif
 
 #include "../formatter.h"
 #include "../log.h"
@@ -34,6 +43,104 @@
 
 #include "resources-physfs.h"
 
+//! Resources smaller than this are read even if they could be mapped, since
+//! mapping them costs more than copying them.
+#define MAP_MIN_BYTES 16384
+
+// Zip records we look at. All fields are little-endian.
+#define ZIP_LOCAL_HEADER        0x04034b50
+#define ZIP_LOCAL_HEADER_SIZE   30
+#define ZIP_CENTRAL_HEADER      0x02014b50
+#define ZIP_CENTRAL_HEADER_SIZE 46
+#define ZIP_END_RECORD          0x06054b50
+#define ZIP_END_RECORD_SIZE     22
+#define ZIP_MAX_COMMENT         0xFFFF
+#define ZIP_FLAG_ENCRYPTED      0x1
+#define ZIP_METHOD_STORED       0
+#define ZIP_SIZE_IN_ZIP64       0xFFFFFFFF
+
+static uint16_t readU16(const char* p)
+{
+	const unsigned char* u = (const unsigned char*)p;
+	return (uint16_t)(u[0] | u[1] << 8);
+}
+
+static uint32_t readU32(const char* p)
+{
+	const unsigned char* u = (const unsigned char*)p;
+	return (uint32_t)u[0] | (uint32_t)u[1] << 8 |
+	       (uint32_t)u[2] << 16 | (uint32_t)u[3] << 24;
+}
+
+
+std::shared_ptr<MappedFile> MappedFile::open(const std::string& path,
+                                             size_t minSize)
+{
+#ifdef _WIN32
+	(void)path;
+	(void)minSize;
+	return std::shared_ptr<MappedFile>();
+#else
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return std::shared_ptr<MappedFile>();
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+	    st.st_size <= 0 || (size_t)st.st_size < minSize ||
+	    (uint64_t)st.st_size > std::numeric_limits<size_t>::max()) {
+		close(fd);
+		return std::shared_ptr<MappedFile>();
+	}
+
+	size_t size = (size_t)st.st_size;
+	void* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return std::shared_ptr<MappedFile>();
+	return std::shared_ptr<MappedFile>(new MappedFile(map, size));
+#endif
+}
+
+MappedFile::MappedFile(void* map, size_t size)
+	: map(map), _size(size)
+{
+}
+
+MappedFile::~MappedFile()
+{
+#ifndef _WIN32
+	munmap(map, _size);
+#endif
+}
+
+const char* MappedFile::data() const
+{
+	return (const char*)map;
+}
+
+size_t MappedFile::size() const
+{
+	return _size;
+}
+
+
+MappedResource::MappedResource(std::shared_ptr<MappedFile> file,
+                               const char* data, size_t size)
+	: file(std::move(file)), _data(data), _size(size)
+{
+}
+
+const void* MappedResource::data()
+{
+	return _data;
+}
+
+size_t MappedResource::size()
+{
+	return _size;
+}
+
 PhysfsResource::PhysfsResource(std::unique_ptr<const char[]> data, size_t size)
 	: _data(std::move(data)), _size(size)
 {
@@ -58,7 +165,7 @@ Resources& Resources::instance()
 }
 
 PhysfsResources::PhysfsResources()
-	: initialized(false)
+	: worldIsDirectory(false)
 {
 }
 
@@ -78,12 +185,134 @@ static void initialize()
 	}
 }
 
+void PhysfsResources::indexWorld()
+{
+	const std::string& datafile = DataWorld::instance().datafile;
+
+	struct stat st;
+	if (stat(datafile.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+		worldIsDirectory = true;
+		return;
+	}
+
+	archive = MappedFile::open(datafile, 0);
+	if (!archive)
+		return;
+
+	const char* zip = archive->data();
+	size_t size = archive->size();
+
+	// The end record is last, followed only by the archive's comment.
+	if (size < ZIP_END_RECORD_SIZE + ZIP_LOCAL_HEADER_SIZE) {
+		archive.reset();
+		return;
+	}
+	size_t end = size - ZIP_END_RECORD_SIZE;
+	size_t stop = end > ZIP_MAX_COMMENT ? end - ZIP_MAX_COMMENT : 0;
+	while (readU32(zip + end) != ZIP_END_RECORD && end > stop)
+		end--;
+
+	size_t count = readU16(zip + end + 10);
+	size_t dirSize = readU32(zip + end + 12);
+	size_t dirOffset = readU32(zip + end + 16);
+	if (readU32(zip + end) != ZIP_END_RECORD ||
+	    dirOffset > end || dirSize > end - dirOffset) {
+		// Not a zip we understand, e.g. Zip64. PhysFS can still
+		// read it.
+		Log::info(
+			"Resources",
+			Formatter("%: could not read zip directory, "
+			          "not mapping files") % datafile
+		);
+		archive.reset();
+		return;
+	}
+
+	const char* p = zip + dirOffset;
+	const char* dirEnd = p + dirSize;
+	for (size_t i = 0; i < count; i++) {
+		if ((size_t)(dirEnd - p) < ZIP_CENTRAL_HEADER_SIZE ||
+		    readU32(p) != ZIP_CENTRAL_HEADER)
+			break;
+
+		uint16_t flags = readU16(p + 8);
+		uint16_t method = readU16(p + 10);
+		uint32_t compressed = readU32(p + 20);
+		uint32_t uncompressed = readU32(p + 24);
+		size_t nameLen = readU16(p + 28);
+		size_t recordLen = ZIP_CENTRAL_HEADER_SIZE + nameLen +
+			readU16(p + 30) + readU16(p + 32);
+		size_t local = readU32(p + 42);
+		if ((size_t)(dirEnd - p) < recordLen)
+			break;
+		std::string name(p + ZIP_CENTRAL_HEADER_SIZE, nameLen);
+		p += recordLen;
+
+		// Only files stored without compression can be handed out
+		// as they are in the archive.
+		if (method != ZIP_METHOD_STORED ||
+		    (flags & ZIP_FLAG_ENCRYPTED) ||
+		    compressed != uncompressed ||
+		    compressed == ZIP_SIZE_IN_ZIP64 ||
+		    compressed < MAP_MIN_BYTES)
+			continue;
+
+		if (local > size - ZIP_LOCAL_HEADER_SIZE ||
+		    readU32(zip + local) != ZIP_LOCAL_HEADER)
+			continue;
+		size_t offset = local + ZIP_LOCAL_HEADER_SIZE +
+			readU16(zip + local + 26) + readU16(zip + local + 28);
+		if (offset > size || compressed > size - offset)
+			continue;
+
+		storedEntries[name] = StoredEntry{offset, compressed};
+	}
+
+	if (storedEntries.empty())
+		archive.reset();
+}
+
+std::unique_ptr<Resource> PhysfsResources::map(const std::string& path)
+{
+	size_t start = path.find_first_not_of('/');
+	if (start == std::string::npos)
+		return std::unique_ptr<Resource>();
+	std::string name = path.substr(start);
+
+	if (worldIsDirectory) {
+		// Leave PhysFS to refuse paths that leave the world.
+		if (name.find("..") != std::string::npos)
+			return std::unique_ptr<Resource>();
+
+		std::shared_ptr<MappedFile> file = MappedFile::open(
+			DataWorld::instance().datafile + "/" + name,
+			MAP_MIN_BYTES);
+		if (!file)
+			return std::unique_ptr<Resource>();
+		const char* data = file->data();
+		size_t size = file->size();
+		return std::make_unique<MappedResource>(std::move(file),
+		                                        data, size);
+	}
+
+	auto it = storedEntries.find(name);
+	if (it == storedEntries.end())
+		return std::unique_ptr<Resource>();
+	const StoredEntry& entry = it->second;
+	return std::make_unique<MappedResource>(archive,
+		archive->data() + entry.offset, entry.size);
+}
+
 std::unique_ptr<Resource> PhysfsResources::load(const std::string& path)
 {
-	if (!initialized) {
-		initialized = true;
+	std::call_once(initialized, [this] {
 		initialize();
-	}
+		indexWorld();
+	});
+
+	std::unique_ptr<Resource> mapped = map(path);
+	if (mapped)
+		return mapped;
 
 	const std::string fullPath = DataWorld::instance().datafile + "/" + path;
 
@@ -167,3 +396,14 @@ std::unique_ptr<Resource> PhysfsResources::load(const std::string& path)
 
 	return std::make_unique<PhysfsResource>(std::move(data), size);
 }
+
+bool PhysfsResources::exists(const std::string& path)
+{
+	std::call_once(initialized, [this] {
+		initialize();
+		indexWorld();
+	});
+
+	return PHYSFS_exists(path.c_str()) != 0;
+}
+
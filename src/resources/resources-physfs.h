@@ -27,6 +27,10 @@
 #ifndef RESOURCES_PHYSFS_H
 #define RESOURCES_PHYSFS_H
 
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
 #include "../resources.h"
 
 class PhysfsResource : public Resource
@@ -43,6 +47,48 @@ private:
 	size_t _size;
 };
 
+//! A file mapped read-only into memory. Unmapped when the last user lets
+//! go of it.
+class MappedFile
+{
+public:
+	//! Returns NULL if the file is smaller than minSize or can't be
+	//! mapped.
+	static std::shared_ptr<MappedFile> open(const std::string& path,
+	                                        size_t minSize);
+
+	~MappedFile();
+
+	const char* data() const;
+	size_t size() const;
+
+private:
+	MappedFile(void* map, size_t size);
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	void* map;
+	size_t _size;
+};
+
+//! A resource that points straight into a MappedFile instead of holding a
+//! copy of its bytes.
+class MappedResource : public Resource
+{
+public:
+	MappedResource(std::shared_ptr<MappedFile> file, const char* data,
+	               size_t size);
+	~MappedResource() = default;
+
+	const void* data();
+	size_t size();
+
+private:
+	std::shared_ptr<MappedFile> file;
+	const char* _data;
+	size_t _size;
+};
+
 class PhysfsResources : public Resources
 {
 public:
@@ -52,12 +98,34 @@ public:
 	bool init();
 
 	std::unique_ptr<Resource> load(const std::string& path);
+	bool exists(const std::string& path);
 
 private:
 	PhysfsResources(const PhysfsResources&) = delete;
 	PhysfsResources& operator=(const PhysfsResources&) = delete;
 
-	bool initialized;
+	//! Find the files we can map instead of reading through PhysFS.
+	void indexWorld();
+
+	//! Try to map a resource. Returns NULL if it has to be read instead.
+	std::unique_ptr<Resource> map(const std::string& path);
+
+	std::once_flag initialized;
+
+	//! Whether the world is a directory rather than an archive.
+	bool worldIsDirectory;
+
+	//! The whole world archive, if mapped.
+	std::shared_ptr<MappedFile> archive;
+
+	struct StoredEntry
+	{
+		size_t offset;
+		size_t size;
+	};
+
+	//! Uncompressed files in the archive and where their bytes are.
+	std::unordered_map<std::string, StoredEntry> storedEntries;
 };
 
 #endif
@@ -30,6 +30,8 @@
 #include <memory>
 #include <string>
 
+#include "resource-id.h"
+
 class SoundInstance
 {
 public:
@@ -77,6 +79,10 @@ public:
 	//! Play a sound from the file at the given path.
 	virtual std::shared_ptr<SoundInstance> play(const std::string& path) = 0;
 
+	//! Play a sound by its interned path. Cheaper for sounds played
+	//! often. Plays nothing for an empty ResourceId.
+	virtual std::shared_ptr<SoundInstance> play(ResourceId id) = 0;
+
 	//! Free sounds not recently played.
 	virtual void garbageCollect() = 0;
 
@@ -108,6 +108,48 @@ bool isDecimal(const std::string& s)
 	return true;
 }
 
+bool parseInteger(const char* s, int* i)
+{
+	const char* p = s;
+	while (isspace(*p))
+		p++;
+	bool negative = *p == '-';
+	if (negative)
+		p++;
+
+	long long n = 0;
+	for (; isdigit(*p); p++)
+		if (n <= INT_MAX)
+			n = n * 10 + (*p - '0');
+	if (*p)
+		return false;
+
+	if (negative)
+		n = -n;
+	*i = (int)bound<long long>(n, INT_MIN, INT_MAX);
+	return true;
+}
+
+bool parseDecimal(const char* s, double* d)
+{
+	const char* p = s;
+	while (isspace(*p))
+		p++;
+	if (*p == '-')
+		p++;
+	while (isdigit(*p))
+		p++;
+	if (*p == '.')
+		p++;
+	while (isdigit(*p))
+		p++;
+	if (*p)
+		return false;
+
+	*d = atof(s);
+	return true;
+}
+
 /**
  * Matches "5-7,2,12-14" no whitespace.
  */
@@ -37,6 +37,12 @@ bool isInteger(const std::string& s);
 //! period.
 bool isDecimal(const std::string& s);
 
+//! Parse a string that isInteger() or isDecimal() would accept, as atoi()
+//! or atof() would, without first copying it into a std::string. Integers
+//! out of range are clamped. Returns false if the string isn't accepted.
+bool parseInteger(const char* s, int* i);
+bool parseDecimal(const char* s, double* d);
+
 bool isRanges(const std::string& s);
 
 
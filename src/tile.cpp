@@ -26,44 +26,23 @@
 
 #include <stdlib.h> // for exit(1) on fatal
 
-#include "area.h"
 #include "formatter.h"
 #include "log.h"
 #include "string.h"
 #include "tile.h"
-#include "world.h"
-
-static int ivec2_to_dir(ivec2 v)
-{
-	switch (v.x) {
-	case -1:
-		return v.y == 0 ? EXIT_LEFT : -1;
-	case 0:
-		switch (v.y) {
-		case -1:
-			return EXIT_UP;
-		case 0:
-			return EXIT_NORMAL;
-		case 1:
-			return EXIT_DOWN;
-		default:
-			return -1;
-		}
-		break;
-	case 1:
-		return v.y == 0 ? EXIT_RIGHT : -1;
-	default:
-		return -1;
-	}
-}
-
 
 /*
  * FLAGMANIP
  */
-FlagManip::FlagManip(unsigned* flags)
-	: flags(flags)
+FlagManip::FlagManip(unsigned* flags, std::function<void ()> onChange)
+	: flags(flags), onChange(onChange)
+{
+}
+
+void FlagManip::changed()
 {
+	if (onChange)
+		onChange();
 }
 
 bool FlagManip::isNowalk() const
@@ -95,30 +74,35 @@ void FlagManip::setNowalk(bool nowalk)
 {
 	*flags &= ~TILE_NOWALK;
 	*flags |= TILE_NOWALK * nowalk;
+	changed();
 }
 
 void FlagManip::setNowalkPlayer(bool nowalk)
 {
 	*flags &= ~TILE_NOWALK_PLAYER;
 	*flags |= TILE_NOWALK_PLAYER * nowalk;
+	changed();
 }
 
 void FlagManip::setNowalkNPC(bool nowalk)
 {
 	*flags &= ~TILE_NOWALK_NPC;
 	*flags |= TILE_NOWALK_NPC * nowalk;
+	changed();
 }
 
 void FlagManip::setNowalkExit(bool nowalk)
 {
 	*flags &= ~TILE_NOWALK_EXIT;
 	*flags |= TILE_NOWALK_EXIT * nowalk;
+	changed();
 }
 
 void FlagManip::setNowalkAreaBound(bool nowalk)
 {
 	*flags &= ~TILE_NOWALK_AREA_BOUND;
 	*flags |= TILE_NOWALK_AREA_BOUND * nowalk;
+	changed();
 }
 
 
@@ -136,29 +120,23 @@ Exit::Exit(const std::string area, int x, int y, double z)
  * TILEBASE
  */
 TileBase::TileBase()
-	: parent(NULL), flags(0x0),
-	  enterScript(NULL), leaveScript(NULL), useScript(NULL)
+	: parent(NULL), flags(0x0)
 {
 }
 
-FlagManip TileBase::flagManip()
-{
-	return FlagManip(&flags);
-}
-
 bool TileBase::hasFlag(unsigned flag) const
 {
 	return flags & flag || (parent && parent->hasFlag(flag));
 }
 
-TileType* TileBase::getType() const
+unsigned TileBase::getFlags() const
 {
-	return (TileType*)parent;
+	return flags;
 }
 
-void TileBase::setType(TileType* type)
+TileType* TileBase::getType() const
 {
-	parent = type;
+	return (TileType*)parent;
 }
 
 
@@ -166,93 +144,9 @@ void TileBase::setType(TileType* type)
  * TILE
  */
 Tile::Tile()
-	: entCnt(0)
 {
 }
 
-Tile::Tile(Area* area, int x, int y, int z)
-	: TileBase(), area(area), x(x), y(y), z(z), entCnt(0)
-{
-	memset(exits, 0, sizeof(exits));
-	memset(layermods, 0, sizeof(layermods));
-}
-
-icoord Tile::moveDest(icoord here, ivec2 facing) const
-{
-	icoord dest = here + icoord(facing.x, facing.y, 0);
-
-	double* layermod = layermodAt(facing);
-	if (layermod)
-		dest = area->virt2phys(vicoord(dest.x, dest.y, *layermod));
-	return dest;
-}
-
-Tile* Tile::offset(int x, int y) const
-{
-	return area->getTile(this->x + x, this->y + y, z);
-}
-
-double Tile::getZ() const
-{
-	vicoord vi = area->phys2virt_vi(icoord(x, y, z));
-	return vi.z;
-}
-
-Exit* Tile::getNormalExit() const
-{
-	return exits[EXIT_NORMAL];
-}
-
-void Tile::setNormalExit(Exit exit)
-{
-	Exit** norm = &exits[EXIT_NORMAL];
-	if (*norm)
-		delete *norm;
-	*norm = new Exit(exit);
-}
-
-Exit* Tile::exitAt(ivec2 dir) const
-{
-	int idx = ivec2_to_dir(dir);
-	return idx == -1 ? NULL : exits[idx];
-}
-
-double* Tile::layermodAt(ivec2 dir) const
-{
-	int idx = ivec2_to_dir(dir);
-	return idx == -1 ? NULL : layermods[idx];
-}
-
-void Tile::runEnterScript(Entity* triggeredBy)
-{
-	DataArea* dataArea = area->getDataArea();
-	for (TileBase* scripted = this; scripted; scripted = scripted->parent) {
-		DataArea::TileScript script = scripted->enterScript;
-		if (script)
-			(dataArea->*script)(*triggeredBy, *this);
-	}
-}
-
-void Tile::runLeaveScript(Entity* triggeredBy)
-{
-	DataArea* dataArea = area->getDataArea();
-	for (TileBase* scripted = this; scripted; scripted = scripted->parent) {
-		DataArea::TileScript script = scripted->leaveScript;
-		if (script)
-			(dataArea->*script)(*triggeredBy, *this);
-	}
-}
-
-void Tile::runUseScript(Entity* triggeredBy)
-{
-	DataArea* dataArea = area->getDataArea();
-	for (TileBase* scripted = this; scripted; scripted = scripted->parent) {
-		DataArea::TileScript script = scripted->useScript;
-		if (script)
-			(dataArea->*script)(*triggeredBy, *this);
-	}
-}
-
 
 /*
  * TILETYPE
@@ -268,11 +162,6 @@ TileType::TileType(const std::shared_ptr<Image>& img)
 	anim = Animation(img);
 }
 
-bool TileType::needsRedraw() const
-{
-	time_t now = World::instance().time();
-	return anim.needsRedraw(now);
-}
 
 /*
  * TILESET
@@ -296,6 +185,13 @@ void TileSet::set(size_t idx, TileType* type)
 	types[idx] = type;
 }
 
+void TileSet::replace(TileType* from, TileType* to)
+{
+	for (auto& type : types)
+		if (type == from)
+			type = to;
+}
+
 TileType* TileSet::at(size_t x, size_t y)
 {
 	size_t i = idx(x, y);
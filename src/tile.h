@@ -27,6 +27,7 @@
 #ifndef TILE_H
 #define TILE_H
 
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -48,7 +49,7 @@ class TileType;
 	Flags are attached to tiles and denote special behavior for
 	the tile they are bound to.
 
-	see AreaTMX::splitTileFlags().
+	see TMXParser::splitTileFlags().
 */
 
 /**
@@ -126,11 +127,14 @@ enum ExitDirection {
 
 /**
  * Independant object that can manipulate a Tile's flags.
+ *
+ * If given, onChange is called after every modification so the owner of the
+ * flags can update anything derived from them. See Area::flagManip().
  */
 class FlagManip
 {
 public:
-	FlagManip(unsigned* flags);
+	FlagManip(unsigned* flags, std::function<void ()> onChange = nullptr);
 
 	bool isNowalk() const;
 	bool isNowalkPlayer() const;
@@ -145,7 +149,10 @@ public:
 	void setNowalkAreaBound(bool nowalk);
 
 private:
+	void changed();
+
 	unsigned* flags;
+	std::function<void ()> onChange;
 };
 
 //! Convenience trigger for inter-area teleportation.
@@ -164,24 +171,29 @@ public:
 	vicoord coords;
 };
 
+//! Flags and type are read-only outside of the Area that owns the tile, so
+//! that its flag bitmaps can't go stale. Change them through
+//! Area::flagManip().
 class TileBase
 {
+	friend class Area;
+	friend class TileSets;
+
 public:
 	TileBase();
 
-	FlagManip flagManip();
-
 	//! Determines whether this tile or one of its parent types embodies a
 	//! flag.
 	bool hasFlag(unsigned flag) const;
 
+	//! Flags set on this tile alone, not on its type.
+	unsigned getFlags() const;
+
 	TileType* getType() const;
-	void setType(TileType* type);
 
-public:
+private:
 	TileBase* parent;
 	unsigned flags;
-	DataArea::TileScript enterScript, leaveScript, useScript;
 };
 
 //! Contains properties unique to this tile.
@@ -190,51 +202,16 @@ public:
 	the area. As opposed to global properties which apply to all
 	tiles of the same type, these properties will only apply to one
 	tile.
+
+	Tiles are kept small so that an Area can store and walk millions of
+	them. Properties that only a few Tiles have, like exits, layermods,
+	scripts and the Entities standing on them, are kept by the Area
+	instead. See Area::exitAt().
 */
 class Tile : public TileBase
 {
 public:
-	Tile(); // Should not be used. Wanted by std::containers.
-	Tile(Area* area, int x, int y, int z);
-
-	/**
-	 * Gets the correct destination for an Entity wanting to
-	 * move off of this tile in <code>facing</code>
-	 * direction.
-	 *
-	 * This call is necessary to handle layermod.
-	 *
-	 * @param here    area-space coordinate for this Tile
-	 * @param facing  facing vector
-	 */
-	icoord moveDest(icoord here, ivec2 facing) const;
-	Tile* offset(int x, int y) const;
-
-	double getZ() const;
-
-	Exit* getNormalExit() const;
-	void setNormalExit(Exit exit);
-
-	Exit* exitAt(ivec2 dir) const;
-	double* layermodAt(ivec2 dir) const;
-
-	void runEnterScript(Entity* triggeredBy);
-	void runLeaveScript(Entity* triggeredBy);
-	void runUseScript(Entity* triggeredBy);
-
-public:
-	Area* area;
-
-	/*
-	 * The grid-space coordinates of this Tile.
-	 *
-	 * Looping Areas utilize area-space components. These
-	 * cannot be losslessly transformed into area-space.
-	 */
-	int x, y, z;
-	Exit* exits[EXITS_LENGTH];
-	double* layermods[EXITS_LENGTH];
-	int entCnt; //!< Number of entities on this Tile.
+	Tile();
 };
 
 //! Contains the properties shared by all tiles of a certain type.
@@ -242,6 +219,9 @@ public:
 	This struct contains global tile properties for a tile of a
 	certain type. As opposed to local properties for a single tile,
 	all tiles of this type will share the defined characteristics.
+
+	TileTypes read from a TSX file are shared by every Area using the
+	file, so scripts, which belong to an Area, are kept by the Area.
 */
 class TileType : public TileBase
 {
@@ -249,12 +229,8 @@ public:
 	TileType();
 	TileType(const std::shared_ptr<Image>& img);
 
-	//! Returns true if onscreen and we need to update our animation.
-	bool needsRedraw() const;
-
 public:
 	Animation anim; //! Graphics for tiles of this type.
-	std::vector<Tile*> allOfType;
 };
 
 class TileSet
@@ -265,6 +241,7 @@ public:
 
 	void add(TileType* type);
 	void set(size_t idx, TileType* type);
+	void replace(TileType* from, TileType* to);
 	TileType* at(size_t x, size_t y);
 	size_t getWidth() const;
 	size_t getHeight() const;
@@ -0,0 +1,157 @@
+/**********************************
+** Tsunagari Tile Engine         **
+** tilesets.cpp                  **
+** Copyright 2015 PariahSoft LLC **
+**********************************/
+
+// **********
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+// **********
+
+
+#include "formatter.h"
+#include "log.h"
+#include "tilesets.h"
+#include "world.h"
+
+size_t TileTypeSet::memoryUsage() const
+{
+	size_t bytes = typesMemoryUsage();
+
+	// The tileset image, counted as 32-bit pixels.
+	if (img && img->size()) {
+		const Image& tile = *(*img)[0];
+		bytes += img->size() * tile.width() * tile.height() * 4;
+	}
+	return bytes;
+}
+
+size_t TileTypeSet::typesMemoryUsage() const
+{
+	return sizeof(*this) + types.capacity() * sizeof(types[0]) +
+	       types.size() * sizeof(TileType);
+}
+
+
+static TileSets globalTileSets;
+
+TileSets& TileSets::instance()
+{
+	return globalTileSets;
+}
+
+TileSets::TileSets()
+	: sets("tile sets")
+{
+}
+
+bool TileSets::shareable(const AreaDesc::TileSetDesc& desc)
+{
+	if (desc.tsxSource.empty())
+		return false;
+
+	// Animations that stop after some cycles are started when their Area
+	// is built, so each Area needs its own.
+	for (auto& type : desc.types)
+		if (type.frames.size() && type.cycles != ANIM_INFINITE_CYCLES)
+			return false;
+	return true;
+}
+
+std::shared_ptr<TileTypeSet> TileSets::load(const std::string& descriptor,
+	const AreaDesc::TileSetDesc& desc, ivec2 tileDim)
+{
+	std::string key = Formatter("%:%x%") % desc.tsxSource %
+		tileDim.x % tileDim.y;
+
+	return sets.lifetimeLoad(key, [&](size_t* bytes) {
+		auto set = build(descriptor, desc, tileDim);
+		// The image is counted by the Images cache it came from.
+		if (set)
+			*bytes = set->typesMemoryUsage();
+		return set;
+	});
+}
+
+std::shared_ptr<TileTypeSet> TileSets::build(const std::string& descriptor,
+	const AreaDesc::TileSetDesc& desc, ivec2 tileDim)
+{
+	if (desc.width < 0 || desc.height < 0 || desc.firstGid < 0) {
+		Log::err(descriptor, "invalid tileset");
+		return NULL;
+	}
+
+	auto set = std::make_shared<TileTypeSet>();
+
+	// Load tileset image.
+	set->img = Images::instance().loadTiles(desc.imgSource,
+		(unsigned)tileDim.x, (unsigned)tileDim.y);
+	if (!set->img) {
+		Log::err(descriptor, "tileset image not found");
+		return NULL;
+	}
+	TiledImage& img = *set->img;
+
+	// Initialize "vanilla" tile type array.
+	for (size_t i = 0; i < img.size(); i++)
+		set->types.push_back(std::make_unique<TileType>(img[i]));
+
+	// Replace the explicitly declared "non-vanilla" types.
+	time_t now = World::instance().time();
+	for (auto& typeDesc : desc.types) {
+		int id = typeDesc.id;
+		if (id < 0 || (int)img.size() <= id) {
+			Log::err(descriptor, "tile type id is invalid");
+			return NULL;
+		}
+		TileType& type = *set->types[(size_t)id];
+
+		type.flags = typeDesc.flags;
+
+		if (typeDesc.frames.empty())
+			continue;
+		if (typeDesc.frameLen == -1) {
+			Log::err(descriptor, "tile type must either have both "
+				"frames and speed or none");
+			return NULL;
+		}
+
+		// Add frames to our animation.
+		std::vector<std::shared_ptr<Image>> framesvec;
+		for (int idx : typeDesc.frames) {
+			if (idx < 0 || (int)img.size() <= idx) {
+				Log::err(descriptor, "frame index out "
+					"of range for animated tile");
+				return NULL;
+			}
+			framesvec.push_back(img[(size_t)idx]);
+		}
+
+		type.anim = Animation(framesvec, typeDesc.frameLen);
+		type.anim.startOver(now, typeDesc.cycles);
+	}
+
+	return set;
+}
+
+void TileSets::garbageCollect()
+{
+	sets.garbageCollect();
+}
+
@@ -0,0 +1,97 @@
+/**********************************
+** Tsunagari Tile Engine         **
+** tilesets.h                    **
+** Copyright 2015 PariahSoft LLC **
+**********************************/
+
+// **********
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+// **********
+
+
+#ifndef TILESETS_H
+#define TILESETS_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "area-desc.h"
+#include "cache-template.cpp"
+#include "images.h"
+#include "tile.h"
+
+/**
+ * The TileTypes of one tileset image, in the order of the tiles in the
+ * image.
+ *
+ * Sets built from a TSX file are shared by every Area that uses the file.
+ * Areas must not change a shared TileType, but make their own copy first.
+ * See Area::ownType().
+ */
+struct TileTypeSet
+{
+	std::shared_ptr<TiledImage> img;
+	std::vector<std::unique_ptr<TileType>> types;
+
+	//! Approximate number of bytes of memory held by the set.
+	size_t memoryUsage() const;
+
+	//! The same, leaving out the image.
+	size_t typesMemoryUsage() const;
+};
+
+class TileSets
+{
+public:
+	//! Acquire the global TileSets object.
+	static TileSets& instance();
+
+	TileSets();
+	~TileSets() = default;
+
+	//! Whether a tileset can be shared between Areas. Only those read
+	//! from TSX files are.
+	static bool shareable(const AreaDesc::TileSetDesc& desc);
+
+	//! Get the shared TileTypes of a shareable tileset, building them if
+	//! they aren't cached. Returns NULL on error. Errors are logged
+	//! against descriptor.
+	std::shared_ptr<TileTypeSet> load(const std::string& descriptor,
+		const AreaDesc::TileSetDesc& desc, ivec2 tileDim);
+
+	//! Build the TileTypes of a tileset. Scripts are left for the Area to
+	//! attach.
+	static std::shared_ptr<TileTypeSet> build(const std::string& descriptor,
+		const AreaDesc::TileSetDesc& desc, ivec2 tileDim);
+
+	//! Free tilesets no Area is using.
+	void garbageCollect();
+
+private:
+	TileSets(const TileSets&) = delete;
+	TileSets(TileSets&&) = delete;
+	TileSets& operator=(const TileSets&) = delete;
+	TileSets& operator=(TileSets&&) = delete;
+
+	Cache<std::shared_ptr<TileTypeSet>> sets;
+};
+
+#endif
+
@@ -0,0 +1,162 @@
+/**********************************
+** Tsunagari Tile Engine         **
+** validation-cache.cpp          **
+** Copyright 2015 PariahSoft LLC **
+**********************************/
+
+// **********
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+// **********
+
+
+#include <fstream>
+
+#include "client-conf.h"
+#include "formatter.h"
+#include "log.h"
+#include "validation-cache.h"
+
+//! First line of the cache file. Change it if the hash function changes.
+#define VALIDATION_CACHE_HEADER "tsunagari-validation-cache 1"
+
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME        1099511628211ULL
+
+static ValidationCache globalValidationCache;
+
+ValidationCache& ValidationCache::instance()
+{
+	return globalValidationCache;
+}
+
+ValidationCache::ValidationCache()
+	: loaded(false), rewrite(true),
+	  validatedCnt(0), validatedBytes(0),
+	  skippedCnt(0), skippedBytes(0),
+	  validatedMicros(0)
+{
+}
+
+uint64_t ValidationCache::hash(const void* data, size_t size, uint64_t seed)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	uint64_t h = seed;
+	for (size_t i = 0; i < size; i++) {
+		h ^= bytes[i];
+		h *= FNV_PRIME;
+	}
+	return h;
+}
+
+uint64_t ValidationCache::hash(const std::string& data, uint64_t seed)
+{
+	return hash(data.data(), data.size(), seed);
+}
+
+uint64_t ValidationCache::hash(const std::string& data)
+{
+	return hash(data, FNV_OFFSET_BASIS);
+}
+
+bool ValidationCache::contains(uint64_t hash)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!loaded)
+		load();
+	return hashes.find(hash) != hashes.end();
+}
+
+void ValidationCache::insert(uint64_t hash)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!loaded)
+		load();
+	if (!hashes.insert(hash).second)
+		return;
+
+	// Append as we go rather than saving on exit, so nothing is lost if
+	// the engine doesn't shut down cleanly.
+	std::ofstream file(VALIDATION_CACHE_PATH,
+		rewrite ? std::ios::trunc : std::ios::app);
+	if (rewrite)
+		file << VALIDATION_CACHE_HEADER << std::endl;
+	file << std::hex << hash << std::endl;
+	if (!file) {
+		Log::err(VALIDATION_CACHE_PATH, "could not save");
+		return;
+	}
+	rewrite = false;
+}
+
+void ValidationCache::validated(size_t bytes, long micros)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	validatedCnt++;
+	validatedBytes += bytes;
+	validatedMicros += micros;
+}
+
+void ValidationCache::skipped(size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	skippedCnt++;
+	skippedBytes += bytes;
+}
+
+void ValidationCache::reportStats() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// Estimate the time saved from how long validation takes per byte
+	// when it does run.
+	double microsPerByte = validatedBytes ?
+		(double)validatedMicros / (double)validatedBytes : 0.0;
+	double savedMillis = microsPerByte * (double)skippedBytes / 1000.0;
+
+	Log::info("ValidationCache", Formatter("validated % documents in % ms, "
+		"skipped % documents, saving about % ms") %
+		validatedCnt % (validatedMicros / 1000) %
+		skippedCnt % savedMillis);
+}
+
+void ValidationCache::load()
+{
+	loaded = true;
+
+	std::ifstream file(VALIDATION_CACHE_PATH);
+	if (!file)
+		return;
+
+	std::string header;
+	std::getline(file, header);
+	if (header != VALIDATION_CACHE_HEADER) {
+		Log::info(VALIDATION_CACHE_PATH,
+			"from another version, starting over");
+		return;
+	}
+
+	uint64_t hash;
+	while (file >> std::hex >> hash)
+		hashes.insert(hash);
+	rewrite = false;
+
+	Log::info(VALIDATION_CACHE_PATH, Formatter("% documents known valid")
+		% hashes.size());
+}
+
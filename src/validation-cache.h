@@ -0,0 +1,97 @@
+/**********************************
+** Tsunagari Tile Engine         **
+** validation-cache.h            **
+** Copyright 2015 PariahSoft LLC **
+**********************************/
+
+// **********
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+// **********
+
+
+#ifndef VALIDATION_CACHE_H
+#define VALIDATION_CACHE_H
+
+#include <stdint.h>
+
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+/**
+ * Remembers, by a hash of their content, which XML documents have passed DTD
+ * validation before so they need not be validated again. The hashes are kept
+ * between runs in the file at VALIDATION_CACHE_PATH.
+ *
+ * Only used if enabled in client.ini.
+ */
+class ValidationCache
+{
+public:
+	//! Acquire the global ValidationCache object.
+	static ValidationCache& instance();
+
+	ValidationCache();
+
+	//! 64-bit FNV-1a hash of a document, continuing from seed. Hash the
+	//! DTD first and use that as the seed so that documents are validated
+	//! again whenever the DTD changes.
+	static uint64_t hash(const void* data, size_t size, uint64_t seed);
+	static uint64_t hash(const std::string& data, uint64_t seed);
+	static uint64_t hash(const std::string& data);
+
+	//! Whether a document with this hash passed validation before.
+	bool contains(uint64_t hash);
+
+	//! Remember that a document passed validation.
+	void insert(uint64_t hash);
+
+	//! Record that a document of some size was validated, and how long that
+	//! took, or that its validation was skipped.
+	void validated(size_t bytes, long micros);
+	void skipped(size_t bytes);
+
+	//! Log how many validations were skipped and roughly how much time
+	//! that saved.
+	void reportStats() const;
+
+private:
+	ValidationCache(const ValidationCache&) = delete;
+	ValidationCache& operator=(const ValidationCache&) = delete;
+
+	//! Read the hashes saved by earlier runs.
+	void load();
+
+	std::unordered_set<uint64_t> hashes;
+	bool loaded;
+
+	//! Whether the file on disk is missing or from another version and
+	//! must be rewritten before new hashes are added.
+	bool rewrite;
+
+	size_t validatedCnt, validatedBytes;
+	size_t skippedCnt, skippedBytes;
+	long validatedMicros;
+
+	//! Documents are loaded from background threads too.
+	mutable std::mutex mutex;
+};
+
+#endif
+
@@ -24,16 +24,23 @@
 // IN THE SOFTWARE.
 // **********
 
+#include <algorithm>
+#include <chrono>
 #include <limits>
+#include <set>
 
+#include "area-prefetch.h"
 #include "area-tmx.h"
+#include "cache.h"
 #include "client-conf.h"
+#include "formatter.h"
 #include "images.h"
 #include "log.h"
 #include "music.h"
 #include "player.h"
 #include "resources.h"
 #include "sounds.h"
+#include "tilesets.h"
 #include "viewport.h"
 #include "window.h"
 #include "world.h"
@@ -42,6 +49,12 @@
 
 #define ASSERT(x)  if (!(x)) { return false; }
 
+//! Upper bounds, in microseconds, of the buckets garbageCollect() pauses
+//! are counted in. A last bucket holds anything longer.
+static const long GC_PAUSE_BOUNDS[] = {10, 30, 100, 300, 1000, 3000, 10000};
+#define GC_PAUSE_BUCKETS \
+	(sizeof(GC_PAUSE_BOUNDS) / sizeof(GC_PAUSE_BOUNDS[0]) + 1)
+
 static World globalWorld;
 
 World& World::instance()
@@ -51,7 +64,9 @@ World& World::instance()
 
 World::World()
 	: player(new Player),
-	  lastTime(0), total(0), redraw(false), userPaused(false), paused(0)
+	  focusCnt(0), evictPending(false),
+	  lastTime(0), total(0), redraw(false), userPaused(false), paused(0),
+	  gcPauses(GC_PAUSE_BUCKETS), gcLongestMicros(0)
 {
 }
 
@@ -169,6 +184,15 @@ bool World::needsRedraw() const
 	return false;
 }
 
+time_t World::nextRedrawTime() const
+{
+	if (redraw)
+		return 0;
+	if (paused)
+		return ANIM_NO_FRAME_CHANGE;
+	return area->nextRedrawTime();
+}
+
 void World::update(time_t now)
 {
 	if (lastTime == 0) {
@@ -182,6 +206,19 @@ void World::update(time_t now)
 			tick(dt);
 		}
 	}
+
+	// Finish, at most one per update, Areas that were read in the
+	// background so taking an exit into them needs no loading.
+	std::string ready;
+	if (AreaPrefetcher::instance().nextReady(&ready)) {
+		getArea(ready);
+		evictPending = true;
+	}
+
+	if (evictPending) {
+		evictPending = false;
+		evictAreas();
+	}
 }
 
 void World::tick(time_t dt)
@@ -207,6 +244,17 @@ Area* World::getArea(const std::string& filename)
 	if (!newArea->init())
 		newArea = NULL;
 
+	// Bring back what the Area had before it was evicted.
+	auto evicted = evictedAreas.find(filename);
+	if (newArea && evicted != evictedAreas.end()) {
+		newArea->restoreState(*evicted->second);
+		evictedAreas.erase(evicted);
+	}
+
+	if (newArea)
+		Log::info(filename, Formatter("loaded, using % KiB")
+			% (newArea->memoryUsage() / 1024));
+
 	areas[filename] = newArea;
 
 	DataArea* dataArea = DataWorld::instance().area(filename);
@@ -233,6 +281,79 @@ void World::focusArea(Area* area, vicoord playerPos)
 	player->setTileCoords(playerPos);
 	Viewport::instance().setArea(area);
 	area->focus();
+	focusTimes[area->getDescriptor()] = ++focusCnt;
+	prefetchExits(area);
+
+	// The Area we left may still be on the stack, so unloading waits
+	// for the next update().
+	evictPending = true;
+}
+
+void World::prefetchExits(Area* area)
+{
+	AreaPrefetcher& prefetcher = AreaPrefetcher::instance();
+	for (auto& dest : area->exitDestinations())
+		if (areas.find(dest) == areas.end())
+			prefetcher.prefetch(dest);
+}
+
+void World::evictAreas()
+{
+	if (conf.areaMemory == 0)
+		return;
+	size_t budget = (size_t)conf.areaMemory * 1024 * 1024;
+
+	size_t total = 0;
+	for (auto& entry : areas)
+		if (entry.second)
+			total += entry.second->memoryUsage();
+	if (total <= budget)
+		return;
+
+	// The focused Area and the ones it leads to stay. Of the rest, those
+	// never focused go first, then the least recently focused.
+	std::set<std::string> keep = area->exitDestinations();
+	keep.insert(area->getDescriptor());
+
+	std::vector<std::pair<unsigned long, std::string>> victims;
+	for (auto& entry : areas) {
+		if (!entry.second || keep.count(entry.first))
+			continue;
+		auto time = focusTimes.find(entry.first);
+		victims.push_back(std::make_pair(
+			time == focusTimes.end() ? 0 : time->second,
+			entry.first));
+	}
+	std::sort(victims.begin(), victims.end());
+
+	for (auto& victim : victims) {
+		if (total <= budget)
+			break;
+
+		const std::string& descriptor = victim.second;
+		Area* old = areas[descriptor];
+		size_t bytes = old->memoryUsage();
+
+		auto state = std::make_unique<AreaState>();
+		old->saveState(state.get());
+		evictedAreas[descriptor] = std::move(state);
+
+		DataArea* dataArea = old->getDataArea();
+		if (dataArea)
+			dataArea->area = NULL;
+		areas.erase(descriptor);
+		focusTimes.erase(descriptor);
+		delete old;
+
+		total -= bytes;
+		Log::info(descriptor, Formatter("unloaded, freeing % KiB")
+			% (bytes / 1024));
+	}
+
+	if (total > budget)
+		Log::info("World", Formatter("loaded areas use % KiB, over "
+			"the budget of % KiB") % (total / 1024) %
+			(budget / 1024));
 }
 
 void World::setPaused(bool b)
@@ -283,10 +404,37 @@ void World::restoreKeys()
 
 void World::garbageCollect()
 {
+	auto start = std::chrono::steady_clock::now();
+
+	// TileTypes hold on to tileset images, so free them first.
+	TileSets::instance().garbageCollect();
 	Images::instance().garbageCollect();
 	Music::instance().garbageCollect();
 	Sounds::instance().garbageCollect();
 	XMLs::instance().garbageCollect();
+	CacheBase::dumpIfRequested();
+
+	long micros = (long)std::chrono::duration_cast<
+		std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - start).count();
+	size_t bucket = 0;
+	while (bucket < GC_PAUSE_BUCKETS - 1 &&
+	       micros >= GC_PAUSE_BOUNDS[bucket])
+		bucket++;
+	gcPauses[bucket]++;
+	gcLongestMicros = std::max(gcLongestMicros, micros);
+}
+
+void World::reportGCPauses() const
+{
+	std::string histogram;
+	for (size_t i = 0; i < GC_PAUSE_BUCKETS - 1; i++)
+		histogram += Formatter("% under % us, ") %
+			gcPauses[i] % GC_PAUSE_BOUNDS[i];
+	histogram += Formatter("% longer") % gcPauses[GC_PAUSE_BUCKETS - 1];
+
+	Log::info("World", Formatter("garbage collection pauses: %; "
+		"longest % us") % histogram % gcLongestMicros);
 }
 
 time_t World::calculateDt(time_t now)
@@ -27,6 +27,7 @@
 #ifndef WORLD_H
 #define WORLD_H
 
+#include <atomic>
 #include <memory>
 #include <stack>
 #include <string>
@@ -37,6 +38,7 @@
 #include "vec.h"
 
 class Area;
+struct AreaState;
 class Image;
 class Player;
 
@@ -83,6 +85,13 @@ public:
 	 */
 	bool needsRedraw() const;
 
+	/**
+	 * Time at which the screen will next need redrawing if nothing else
+	 * happens. Returns 0 if a redraw is already due. A backend that can
+	 * block waiting for input may wait until then.
+	 */
+	time_t nextRedrawTime() const;
+
 	void update(time_t now);
 
 	/**
@@ -135,8 +144,13 @@ public:
 
 	//! Expunge old resources cached in memory. Decisions on which are
 	//! removed and which are kept are based on the global Conf struct.
+	//! Each call does a bounded amount of work, so it can be called
+	//! often.
 	void garbageCollect();
 
+	//! Log a histogram of how long calls to garbageCollect() took.
+	void reportGCPauses() const;
+
 	// ScriptRef keydownScript, keyupScript;
 
 protected:
@@ -152,6 +166,19 @@ protected:
 	 */
 	void pushLetterbox();
 
+	/**
+	 * Begin reading, in the background, the Areas that an Area's exits
+	 * lead to.
+	 */
+	void prefetchExits(Area* area);
+
+	/**
+	 * Unload the least recently focused Areas until those loaded fit in
+	 * the memory budget from client.ini. Their state is kept so they
+	 * can be restored when loaded again.
+	 */
+	void evictAreas();
+
 protected:
 	typedef std::map<std::string, Area*> AreaMap;
 
@@ -161,21 +188,38 @@ protected:
 	Area* area;
 	std::unique_ptr<Player> player;
 
+	//! State of Areas unloaded by evictAreas(), by descriptor.
+	std::map<std::string, std::unique_ptr<AreaState>> evictedAreas;
+
+	//! When each loaded Area was last focused, counted in calls to
+	//! focusArea(). Areas never focused are absent.
+	std::map<std::string, unsigned long> focusTimes;
+	unsigned long focusCnt;
+
+	//! Whether evictAreas() should run on the next update().
+	bool evictPending;
+
 	/**
 	 * Last time engine state was updated. See World::update().
 	 */
 	time_t lastTime;
 
 	/**
-	 * Total unpaused game run time.
+	 * Total unpaused game run time. Read by the threads that prefetch
+	 * Areas.
 	 */
-	time_t total;
+	std::atomic<time_t> total;
 
 	bool redraw;
 	bool userPaused;
 	int paused;
 
 	std::stack<BitRecord> keyStates;
+
+	//! Calls to garbageCollect() counted by how long they took, in the
+	//! buckets of GC_PAUSE_BOUNDS, and the longest one.
+	std::vector<unsigned long> gcPauses;
+	long gcLongestMicros;
 };
 
 #endif
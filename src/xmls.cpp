@@ -27,10 +27,15 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <chrono>
+
+#include "client-conf.h"
 #include "dtds.h"
+#include "formatter.h"
 #include "log.h"
 #include "resources.h"
 #include "string.h"
+#include "validation-cache.h"
 #include "xmls.h"
 
 #ifdef _WIN32
@@ -40,6 +45,28 @@
 #define ASSERT(x)  if (!(x)) { return false; }
 
 
+static const std::string noPath;
+
+//! A NULL s is a missing attribute, which reads as 0.
+static bool parseInt(const std::string& path, const char* s, int* i)
+{
+	if (!parseInteger(s ? s : "", i)) {
+		Log::err(path, "expected integer");
+		return false;
+	}
+	return true;
+}
+
+static bool parseDouble(const std::string& path, const char* s, double* d)
+{
+	if (!parseDecimal(s ? s : "", d)) {
+		Log::err(path, "expected decimal");
+		return false;
+	}
+	return true;
+}
+
+
 XMLNode::XMLNode()
 {
 }
@@ -74,59 +101,57 @@ std::string XMLNode::content() const
 
 bool XMLNode::intContent(int* i) const
 {
-	std::string s = content();
-	if (!isInteger(s)) {
-		Log::err(doc->path(), "expected integer");
-		return false;
-	}
-	*i = atoi(s.c_str());
-	return true;
+	return parseInt(doc->path(), content().c_str(), i);
 }
 
 bool XMLNode::doubleContent(double *d) const
 {
-	std::string s = content();
-	if (!isDecimal(s)) {
-		Log::err(doc->path(), "expected decimal");
-		return false;
-	}
-	*d = atof(s.c_str());
-	return true;
+	return parseDouble(doc->path(), content().c_str(), d);
 }
 
-bool XMLNode::hasAttr(const std::string& name) const
+bool XMLNode::hasAttr(const char* name) const
 {
-	return xmlHasProp(node, BAD_CAST(name.c_str()));
+	return xmlHasProp(node, BAD_CAST(name));
 }
 
-std::string XMLNode::attr(const std::string& name) const
+std::string XMLNode::attr(const char* name) const
 {
-	xmlChar* content = xmlGetProp(node, BAD_CAST(name.c_str()));
-	std::string s = content ? (const char*)content : "";
-	xmlFree(content);
-	return s;
+	const char* value = attrView(name);
+	return value ? value : "";
 }
 
-bool XMLNode::intAttr(const std::string& name, int* i) const
+bool XMLNode::intAttr(const char* name, int* i) const
 {
-	std::string s = attr(name);
-	if (!isInteger(s)) {
-		Log::err(doc->path(), "expected integer");
-		return false;
-	}
-	*i = atoi(s.c_str());
-	return true;
+	return parseInt(doc->path(), attrView(name), i);
 }
 
-bool XMLNode::doubleAttr(const std::string& name, double* d) const
+bool XMLNode::doubleAttr(const char* name, double* d) const
 {
-	std::string s = attr(name);
-	if (!isDecimal(s)) {
-		Log::err(doc->path(), "expected decimal");
-		return false;
+	return parseDouble(doc->path(), attrView(name), d);
+}
+
+const char* XMLNode::attrView(const char* name) const
+{
+	xmlAttr* attr = xmlHasProp(node, BAD_CAST(name));
+	if (!attr)
+		return NULL;
+
+	// Defaulted from the DTD.
+	if (attr->type == XML_ATTRIBUTE_DECL) {
+		xmlAttribute* decl = (xmlAttribute*)attr;
+		return decl->defaultValue ?
+			(const char*)decl->defaultValue : "";
 	}
-	*d = atof(s.c_str());
-	return true;
+
+	// The common case: the value is a single text node we can point into.
+	xmlNode* text = attr->children;
+	if (!text)
+		return "";
+	if (text->type == XML_TEXT_NODE && !text->next)
+		return (const char*)text->content;
+
+	// Entity references split the value into several nodes.
+	return doc->joinedValue(attr);
 }
 
 XMLNode::operator bool() const
@@ -172,10 +197,17 @@ bool XMLDoc::init(const std::string& path,
 		return false;
 	}
 
+	if (!dtd)
+		return true;
+
 	// Assert the document is sane.
+	auto start = std::chrono::steady_clock::now();
 	xmlValidCtxt* vc = xmlNewValidCtxt();
 	int valid = xmlValidateDtd(vc, doc.get(), dtd);
 	xmlFreeValidCtxt(vc);
+	auto micros = std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - start).count();
+	ValidationCache::instance().validated(data.size(), (long)micros);
 
 	if (!valid) {
 		doc.reset();
@@ -211,6 +243,46 @@ bool XMLDoc::unique() const
 	return doc.unique();
 }
 
+const char* XMLDoc::joinedValue(xmlAttr* attr)
+{
+	std::lock_guard<std::mutex> lock(joinedMutex);
+	auto it = joined.find(attr);
+	if (it != joined.end())
+		return it->second.c_str();
+
+	xmlChar* content = xmlNodeListGetString(attr->doc, attr->children, 1);
+	std::string& value = joined[attr];
+	if (content)
+		value = (const char*)content;
+	xmlFree(content);
+	return value.c_str();
+}
+
+//! Count the nodes, attributes and text of a list of siblings and all
+//! that is beneath them.
+static size_t treeMemoryUsage(xmlNode* node)
+{
+	size_t bytes = 0;
+	for (; node; node = node->next) {
+		bytes += sizeof(xmlNode);
+		if (node->content)
+			bytes += strlen((const char*)node->content) + 1;
+		if (node->type == XML_ELEMENT_NODE)
+			for (xmlAttr* a = node->properties; a; a = a->next)
+				bytes += sizeof(xmlAttr) +
+				         treeMemoryUsage(a->children);
+		bytes += treeMemoryUsage(node->children);
+	}
+	return bytes;
+}
+
+size_t XMLDoc::memoryUsage() const
+{
+	if (!doc)
+		return 0;
+	return sizeof(xmlDoc) + treeMemoryUsage(doc->children);
+}
+
 long XMLDoc::use_count() const
 {
 	return doc.use_count();
@@ -218,8 +290,208 @@ long XMLDoc::use_count() const
 
 
 
+XMLStreamNode::XMLStreamNode()
+	: stream(NULL), depth(0), seq(0), empty(true)
+{
+}
+
+XMLStreamNode::XMLStreamNode(XMLStream* stream, int depth, size_t seq,
+                             bool empty)
+	: stream(stream), depth(depth), seq(seq), empty(empty)
+{
+}
+
+XMLStreamNode XMLStreamNode::childrenNode() const
+{
+	if (empty || !current())
+		return XMLStreamNode();
+
+	// Our children are one level deeper. Reaching our own depth again
+	// means we hit our end tag.
+	while (stream->read()) {
+		int d = xmlTextReaderDepth(stream->reader);
+		if (d <= depth)
+			break;
+		if (d == depth + 1 && xmlTextReaderNodeType(stream->reader) ==
+		                      XML_READER_TYPE_ELEMENT)
+			return stream->node();
+	}
+	return XMLStreamNode();
+}
+
+XMLStreamNode XMLStreamNode::next() const
+{
+	if (!stream)
+		return XMLStreamNode();
+
+	// Skip whatever is left of this element. Going shallower than it
+	// means we hit our parent's end tag.
+	do {
+		int d = xmlTextReaderDepth(stream->reader);
+		if (d < depth)
+			break;
+		if (d == depth && stream->seq != seq &&
+		    xmlTextReaderNodeType(stream->reader) ==
+		    XML_READER_TYPE_ELEMENT)
+			return stream->node();
+	} while (stream->read());
+	return XMLStreamNode();
+}
+
+bool XMLStreamNode::is(const char* name) const
+{
+	if (!current())
+		return false;
+	const xmlChar* ourName = xmlTextReaderConstName(stream->reader);
+	return ourName && !xmlStrcmp(ourName, BAD_CAST(name));
+}
+
+std::string XMLStreamNode::content() const
+{
+	if (!current())
+		return "";
+	xmlChar* content = xmlTextReaderReadString(stream->reader);
+	std::string s = content ? (const char*)content : "";
+	xmlFree(content);
+	return s;
+}
+
+bool XMLStreamNode::hasAttr(const char* name) const
+{
+	if (!current())
+		return false;
+	xmlTextReaderPtr reader = stream->reader;
+	if (xmlTextReaderMoveToAttribute(reader, BAD_CAST(name)) != 1)
+		return false;
+	xmlTextReaderMoveToElement(reader);
+	return true;
+}
+
+std::string XMLStreamNode::attr(const char* name) const
+{
+	const char* value = attrView(name);
+	return value ? value : "";
+}
+
+bool XMLStreamNode::intAttr(const char* name, int* i) const
+{
+	return parseInt(stream ? stream->path() : noPath, attrView(name), i);
+}
+
+bool XMLStreamNode::doubleAttr(const char* name, double* d) const
+{
+	return parseDouble(stream ? stream->path() : noPath, attrView(name),
+	                   d);
+}
+
+const char* XMLStreamNode::attrView(const char* name) const
+{
+	if (!current()) {
+		if (stream)
+			Log::err(stream->path(), Formatter(
+				"attribute % read out of order") % name);
+		return NULL;
+	}
+	xmlTextReaderPtr reader = stream->reader;
+	if (xmlTextReaderMoveToAttribute(reader, BAD_CAST(name)) != 1)
+		return NULL;
+	// The reader keeps the value until it next builds one, so it survives
+	// moving back to the element.
+	const xmlChar* value = xmlTextReaderConstValue(reader);
+	xmlTextReaderMoveToElement(reader);
+	return value ? (const char*)value : "";
+}
+
+XMLStreamNode::operator bool() const
+{
+	return stream != NULL;
+}
+
+bool XMLStreamNode::current() const
+{
+	return stream && stream->seq == seq &&
+	       xmlTextReaderNodeType(stream->reader) ==
+	       XML_READER_TYPE_ELEMENT;
+}
+
+
+static void xmlStreamErrorCb(void* pstrFilename, const char* msg,
+                             xmlParserSeverities, xmlTextReaderLocatorPtr)
+{
+	const std::string* filename = (const std::string*)pstrFilename;
+	Log::err(*filename, msg);
+}
+
+XMLStream::XMLStream()
+	: reader(NULL), seq(0), failed(false)
+{
+}
+
+XMLStream::~XMLStream()
+{
+	if (reader)
+		xmlFreeTextReader(reader);
+}
+
+bool XMLStream::init(const std::string& path, std::unique_ptr<Resource> data)
+{
+	this->path_ = path;
+	this->data = std::move(data);
+
+	reader = xmlReaderForMemory((const char*)this->data->data(),
+		(int)this->data->size(), NULL, NULL,
+		XML_PARSE_NOBLANKS | XML_PARSE_NONET);
+	if (!reader) {
+		Log::err(path, "could not parse file");
+		return false;
+	}
+	xmlTextReaderSetErrorHandler(reader, xmlStreamErrorCb, &path_);
+	return true;
+}
+
+XMLStreamNode XMLStream::root()
+{
+	while (read())
+		if (xmlTextReaderNodeType(reader) == XML_READER_TYPE_ELEMENT)
+			return node();
+	return XMLStreamNode();
+}
+
+const std::string& XMLStream::path() const
+{
+	return path_;
+}
+
+XMLStream::operator bool() const
+{
+	return reader && !failed;
+}
+
+bool XMLStream::read()
+{
+	int ret = xmlTextReaderRead(reader);
+	if (ret == -1)
+		failed = true;
+	if (ret != 1)
+		return false;
+	if (xmlTextReaderNodeType(reader) == XML_READER_TYPE_ELEMENT)
+		seq++;
+	return true;
+}
+
+XMLStreamNode XMLStream::node()
+{
+	return XMLStreamNode(this, xmlTextReaderDepth(reader), seq,
+		xmlTextReaderIsEmptyElement(reader) == 1);
+}
+
+
 static std::map<std::string, std::shared_ptr<xmlDtd>> dtds;
 
+//! Hash of each DTD's text, used to seed the hashes of documents checked
+//! against it.
+static std::map<std::string, uint64_t> dtdHashes;
+
 static std::shared_ptr<xmlDtd> parseDTD(const std::string& dtdContent)
 {
 	xmlCharEncoding enc = XML_CHAR_ENCODING_NONE;
@@ -236,11 +508,18 @@ static std::shared_ptr<xmlDtd> parseDTD(const std::string& dtdContent)
 	return std::shared_ptr<xmlDtd>(dtd, xmlFreeDtd);
 }
 
+static bool preloadDTD(const std::string& type, const std::string& content)
+{
+	ASSERT(dtds[type] = parseDTD(content));
+	dtdHashes[type] = ValidationCache::hash(content);
+	return true;
+}
+
 static bool preloadDTDs()
 {
-	ASSERT(dtds["area"] = parseDTD(CONTENT_OF_AREA_DTD()));
-	ASSERT(dtds["entity"] = parseDTD(CONTENT_OF_ENTITY_DTD()));
-	ASSERT(dtds["tsx"] = parseDTD(CONTENT_OF_TSX_DTD()));
+	ASSERT(preloadDTD("area", CONTENT_OF_AREA_DTD()));
+	ASSERT(preloadDTD("entity", CONTENT_OF_ENTITY_DTD()));
+	ASSERT(preloadDTD("tsx", CONTENT_OF_TSX_DTD()));
 	return true;
 }
 
@@ -259,6 +538,7 @@ XMLs& XMLs::instance()
 }
 
 XMLs::XMLs()
+	: documents("xml documents")
 {
 	preloadDTDs();
 }
@@ -275,21 +555,48 @@ static std::shared_ptr<XMLDoc> genXML(const std::string& path,
 
 	if (!dtd || data.empty())
 		return NULL;
+
+	// Documents that were valid before are still valid if neither they nor
+	// their DTD have changed.
+	ValidationCache& cache = ValidationCache::instance();
+	uint64_t hash = 0;
+	if (conf.validationCache) {
+		hash = ValidationCache::hash(data, dtdHashes.at(dtdType));
+		if (cache.contains(hash)) {
+			cache.skipped(data.size());
+			dtd = NULL;
+		}
+	}
+
 	auto doc = std::make_shared<XMLDoc>();
 	if (!doc->init(path, data, dtd))
 		doc.reset();
+	else if (conf.validationCache && dtd)
+		cache.insert(hash);
 	return doc;
 }
 
 std::shared_ptr<XMLDoc> XMLs::load(const std::string& path,
 	const std::string& dtdType)
 {
-	auto doc = documents.lifetimeRequest(path);
-	if (!doc) {
-		doc = genXML(path, dtdType);
-		documents.lifetimePut(path, doc);
-	}
-	return doc;
+	return documents.lifetimeLoad(path, [&](size_t* bytes) {
+		auto doc = genXML(path, dtdType);
+		if (doc)
+			*bytes = doc->memoryUsage();
+		return doc;
+	});
+}
+
+std::shared_ptr<XMLStream> XMLs::stream(const std::string& path)
+{
+	std::unique_ptr<Resource> r = Resources::instance().load(path);
+	if (!r)
+		return NULL;
+
+	auto stream = std::make_shared<XMLStream>();
+	if (!stream->init(path, std::move(r)))
+		stream.reset();
+	return stream;
 }
 
 void XMLs::garbageCollect()
@@ -28,9 +28,12 @@
 #define XML_H
 
 #include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 
 #include <libxml/tree.h>
+#include <libxml/xmlreader.h>
 
 #include "cache-template.cpp"
 
@@ -38,7 +41,9 @@
 	#error Tree must be enabled in libxml2
 #endif
 
+class Resource;
 class XMLDoc;
+class XMLStream;
 
 class XMLNode {
 public:
@@ -54,10 +59,15 @@ public:
 	bool intContent(int* i) const;
 	bool doubleContent(double* d) const;
 
-	bool hasAttr(const std::string& name) const;
-	std::string attr(const std::string& name) const;
-	bool intAttr(const std::string& name, int* i) const;
-	bool doubleAttr(const std::string& name, double* d) const;
+	bool hasAttr(const char* name) const;
+	std::string attr(const char* name) const;
+	bool intAttr(const char* name, int* i) const;
+	bool doubleAttr(const char* name, double* d) const;
+
+	//! Like attr(), but returns a view into libxml2's storage instead of
+	//! a copy, or NULL if the attribute is missing. The view lives as
+	//! long as the document.
+	const char* attrView(const char* name) const;
 
 	//! Whether this is a valid node (non-NULL).
 	operator bool() const;
@@ -70,6 +80,9 @@ private:
 class XMLDoc {
 public:
 	XMLDoc();
+
+	//! Parse the document and validate it against dtd. A NULL dtd skips
+	//! validation.
 	bool init(const std::string& path,
 	          const std::string& data,
 	          xmlDtd* dtd);
@@ -84,13 +97,109 @@ public:
 	//! Equivalent to doc::use_count().
 	long use_count() const;
 
+	//! Approximate number of bytes of memory held by the parsed tree.
+	size_t memoryUsage() const;
+
 	//! Signifies whether document is has been initialized, parsed
 	//! correctly, and is valid.
 	operator bool() const;
 
 private:
+	friend class XMLNode;
+
+	//! The value of an attribute that libxml2 doesn't store contiguously,
+	//! joined the first time it is asked for. Lives as long as the
+	//! document does.
+	const char* joinedValue(xmlAttr* attr);
+
 	std::shared_ptr<xmlDoc> doc;
 	std::string path_;
+
+	//! Values joined by joinedValue(), by attribute.
+	std::unordered_map<const xmlAttr*, std::string> joined;
+	std::mutex joinedMutex;
+};
+
+//! An element of an XMLStream.
+/*!
+	Works like an XMLNode, but only moves forward through the document.
+	An element's attributes must be read before its children, and its
+	children can only be walked once.
+*/
+class XMLStreamNode {
+public:
+	XMLStreamNode();
+	XMLStreamNode(XMLStream* stream, int depth, size_t seq, bool empty);
+
+	XMLStreamNode childrenNode() const;
+	XMLStreamNode next() const;
+
+	bool is(const char* name) const;
+
+	std::string content() const;
+
+	bool hasAttr(const char* name) const;
+	std::string attr(const char* name) const;
+	bool intAttr(const char* name, int* i) const;
+	bool doubleAttr(const char* name, double* d) const;
+
+	//! Like attr(), but returns a view into the reader's storage instead
+	//! of a copy, or NULL if the attribute is missing. The view is only
+	//! good until the next attribute is read or the stream moves on.
+	const char* attrView(const char* name) const;
+
+	//! Whether this is a valid node (non-NULL).
+	operator bool() const;
+
+private:
+	//! Whether the stream is still on this element's start tag.
+	bool current() const;
+
+	XMLStream* stream;
+	int depth;
+	size_t seq;
+	bool empty;
+};
+
+//! Reads an XML document one node at a time without building a tree.
+/*!
+	Memory use stays close to the size of the document itself. Unlike an
+	XMLDoc, the document is not validated against a DTD.
+*/
+class XMLStream {
+public:
+	XMLStream();
+	~XMLStream();
+
+	bool init(const std::string& path, std::unique_ptr<Resource> data);
+
+	//! The document's root element. Can only be called once.
+	XMLStreamNode root();
+	const std::string& path() const;
+
+	//! False once the document was found to be malformed.
+	operator bool() const;
+
+private:
+	XMLStream(const XMLStream&) = delete;
+	XMLStream& operator=(const XMLStream&) = delete;
+
+	friend class XMLStreamNode;
+
+	//! Advance to the next node. Returns false at the end of the document
+	//! or on an error.
+	bool read();
+
+	//! The element the reader is on.
+	XMLStreamNode node();
+
+	xmlTextReader* reader;
+	std::unique_ptr<Resource> data;
+	std::string path_;
+
+	//! Number of start tags read so far. Identifies an element.
+	size_t seq;
+	bool failed;
 };
 
 class XMLs {
@@ -105,6 +214,10 @@ public:
 	std::shared_ptr<XMLDoc> load(const std::string& path,
 		const std::string& dtdType);
 
+	//! Open an XML document to be read as a stream. Streams are not
+	//! cached.
+	std::shared_ptr<XMLStream> stream(const std::string& path);
+
 	//! Free XML documents not recently used.
 	void garbageCollect();
 
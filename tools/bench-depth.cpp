@@ -0,0 +1,213 @@
+/**********************************
+** Tsunagari Tile Engine         **
+** bench-depth.cpp               **
+** Copyright 2015 PariahSoft LLC **
+**********************************/
+
+// **********
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+// **********
+
+// Cost of Area::getTile(vicoord), which turns a layer depth into a layer
+// index on every call. Compares the std::map<double, int> Area used to
+// keep with the sorted vector of pairs it keeps now, alone and as part of
+// a whole getTile(vicoord). The map is small enough to stay in cache, so
+// this measures the lookups rather than memory.
+
+#include <limits.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "bench.h"
+#include "math.h"
+
+#define MAP_W 64
+#define MAP_H 64
+#define CHUNK 16
+
+//! The layer depths of a typical Area.
+static const double depths[] = {
+	-1.0, 0.0, 0.5, 1.0, 1.5, 2.0, 3.0, 10.0
+};
+#define MAP_D ((int)(sizeof(depths) / sizeof(depths[0])))
+
+struct Tile
+{
+	void* parent;
+	unsigned flags;
+};
+
+struct vicoord
+{
+	int x, y;
+	double z;
+};
+
+//! Keeps the compiler from optimizing the lookups away.
+static volatile size_t sink;
+
+//! Before: a tree of depths, and rows of Tiles.
+struct Before
+{
+	std::map<double, int> depth2idx;
+	std::vector<std::vector<std::vector<Tile>>> map;
+	bool loopX, loopY;
+
+	Before() : loopX(false), loopY(false)
+	{
+		for (int i = 0; i < MAP_D; i++)
+			depth2idx[depths[i]] = i;
+		map.assign(MAP_D, std::vector<std::vector<Tile>>(MAP_H,
+			std::vector<Tile>(MAP_W, Tile())));
+	}
+
+	int depthIndex(double depth) const
+	{
+		auto it = depth2idx.find(depth);
+		return it == depth2idx.end() ? -1 : it->second;
+	}
+
+	bool inBounds(int x, int y, int z) const
+	{
+		return ((loopX || (0 <= x && x < MAP_W)) &&
+			(loopY || (0 <= y && y < MAP_H)) &&
+			          0 <= z && z < MAP_D);
+	}
+
+	const Tile* getTile(vicoord virt) const
+	{
+		int x = virt.x, y = virt.y, z = depthIndex(virt.z);
+		if (loopX)
+			x = wrap(0, x, MAP_W);
+		if (loopY)
+			y = wrap(0, y, MAP_H);
+		if (inBounds(x, y, z))
+			return &map[(size_t)z][(size_t)y][(size_t)x];
+		else
+			return NULL;
+	}
+};
+
+//! Now: depths in a sorted vector, and Tiles in chunks.
+struct After
+{
+	std::vector<std::pair<double, int>> depth2idx;
+	std::vector<Tile> tiles;
+	std::vector<Tile*> chunks;
+	bool loopX, loopY;
+
+	After() : loopX(false), loopY(false)
+	{
+		for (int i = 0; i < MAP_D; i++)
+			depth2idx.push_back(std::make_pair(depths[i], i));
+		std::sort(depth2idx.begin(), depth2idx.end());
+		tiles.resize((size_t)MAP_W * MAP_H * MAP_D);
+		for (size_t i = 0; i < tiles.size(); i += CHUNK * CHUNK)
+			chunks.push_back(&tiles[i]);
+	}
+
+	int depthIndex(double depth) const
+	{
+		auto it = std::lower_bound(depth2idx.begin(), depth2idx.end(),
+		                           std::make_pair(depth, INT_MIN));
+		if (it == depth2idx.end() || it->first != depth)
+			return -1;
+		return it->second;
+	}
+
+	bool inBounds(int x, int y, int z) const
+	{
+		return ((loopX || (0 <= x && x < MAP_W)) &&
+			(loopY || (0 <= y && y < MAP_H)) &&
+			          0 <= z && z < MAP_D);
+	}
+
+	const Tile* getTile(vicoord virt) const
+	{
+		int x = virt.x, y = virt.y, z = depthIndex(virt.z);
+		if (loopX)
+			x = wrap(0, x, MAP_W);
+		if (loopY)
+			y = wrap(0, y, MAP_H);
+		if (!inBounds(x, y, z))
+			return NULL;
+		const Tile* chunk = chunks[((size_t)z * (MAP_H / CHUNK) +
+			(size_t)(y / CHUNK)) * (MAP_W / CHUNK) +
+			(size_t)(x / CHUNK)];
+		return chunk ? &chunk[(size_t)(y % CHUNK) * CHUNK +
+			(size_t)(x % CHUNK)] : NULL;
+	}
+};
+
+template<class Area>
+static void lookups(const char* name, const Area& area,
+                    const std::vector<vicoord>& coords)
+{
+	benchRate(name, "lookups", [&] {
+		int sum = 0;
+		for (const vicoord& c : coords)
+			sum += area.depthIndex(c.z);
+		sink = sink + (size_t)sum;
+		return coords.size();
+	});
+}
+
+template<class Area>
+static void getTiles(const char* name, const Area& area,
+                     const std::vector<vicoord>& coords)
+{
+	benchRate(name, "calls", [&] {
+		size_t sum = 0;
+		for (const vicoord& c : coords)
+			sum += (size_t)area.getTile(c);
+		sink = sink + sum;
+		return coords.size();
+	});
+}
+
+int main()
+{
+	srand(1);
+
+	Before before;
+	After after;
+
+	std::vector<vicoord> coords;
+	for (int i = 0; i < 4096; i++) {
+		vicoord c;
+		c.x = rand() % MAP_W;
+		c.y = rand() % MAP_H;
+		c.z = depths[rand() % MAP_D];
+		coords.push_back(c);
+	}
+
+	printf("depth to layer index, %d layers:\n", MAP_D);
+	lookups("std::map", before, coords);
+	lookups("sorted vector", after, coords);
+	printf("getTile(vicoord):\n");
+	getTiles("map and nested rows", before, coords);
+	getTiles("sorted vector and chunks", after, coords);
+
+	return 0;
+}
+
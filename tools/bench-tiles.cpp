@@ -0,0 +1,260 @@
+/**********************************
+** Tsunagari Tile Engine         **
+** bench-tiles.cpp               **
+** Copyright 2015 PariahSoft LLC **
+**********************************/
+
+// **********
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+// **********
+
+// Visible-cube scan throughput of the three layouts Area has stored its
+// Tiles in: a vector of layers of rows, one flat layer-major buffer, and
+// 16x16 chunks. Each frame visits every Tile in a 20x15 viewport on all
+// eight layers of a 512x512 map, the way Area::drawTiles() does, and
+// reads the Tile's type and flags.
+
+#include <stdlib.h>
+
+#include <vector>
+
+#include "bench.h"
+#include "math.h"
+
+#define MAP_W 512
+#define MAP_H 512
+#define MAP_D 8
+#define VIEW_W 20
+#define VIEW_H 15
+#define CHUNK 16
+
+//! Same size and layout as the engine's Tile.
+struct Tile
+{
+	void* parent;
+	unsigned flags;
+};
+
+static char someType;
+
+static Tile randomTile()
+{
+	Tile tile;
+	tile.parent = rand() % 4 ? &someType : NULL;
+	tile.flags = (unsigned)(rand() % 8);
+	return tile;
+}
+
+//! Where the viewport is on each frame.
+struct Views
+{
+	std::vector<int> x, y;
+};
+
+static Views scrolling(size_t frames)
+{
+	Views v;
+	int x = 0, y = 0;
+	for (size_t i = 0; i < frames; i++) {
+		x = (x + 1) % (MAP_W - VIEW_W);
+		if (x == 0)
+			y = (y + VIEW_H) % (MAP_H - VIEW_H);
+		v.x.push_back(x);
+		v.y.push_back(y);
+	}
+	return v;
+}
+
+static Views jumping(size_t frames)
+{
+	Views v;
+	for (size_t i = 0; i < frames; i++) {
+		v.x.push_back(rand() % (MAP_W - VIEW_W));
+		v.y.push_back(rand() % (MAP_H - VIEW_H));
+	}
+	return v;
+}
+
+//! Keeps the compiler from optimizing the scans away.
+static volatile unsigned sink;
+
+//! Before: vector<vector<vector<Tile>>>, one getTile() per Tile.
+struct Nested
+{
+	std::vector<std::vector<std::vector<Tile>>> map;
+	bool loopX, loopY;
+
+	Nested() : loopX(false), loopY(false)
+	{
+		map.resize(MAP_D);
+		for (auto& grid : map) {
+			grid.resize(MAP_H);
+			for (auto& row : grid) {
+				row.reserve(MAP_W);
+				for (int x = 0; x < MAP_W; x++)
+					row.push_back(randomTile());
+			}
+		}
+	}
+
+	bool inBounds(int x, int y, int z) const
+	{
+		return ((loopX || (0 <= x && x < MAP_W)) &&
+			(loopY || (0 <= y && y < MAP_H)) &&
+			          0 <= z && z < MAP_D);
+	}
+
+	const Tile* getTile(int x, int y, int z) const
+	{
+		if (loopX)
+			x = wrap(0, x, MAP_W);
+		if (loopY)
+			y = wrap(0, y, MAP_H);
+		if (inBounds(x, y, z))
+			return &map[(size_t)z][(size_t)y][(size_t)x];
+		else
+			return NULL;
+	}
+
+	size_t frame(int x1, int y1) const
+	{
+		unsigned sum = 0;
+		for (int z = 0; z < MAP_D; z++)
+			for (int y = y1; y < y1 + VIEW_H; y++)
+				for (int x = x1; x < x1 + VIEW_W; x++) {
+					const Tile* tile = getTile(x, y, z);
+					if (tile->parent)
+						sum += tile->flags;
+				}
+		sink = sink + sum;
+		return MAP_D * VIEW_H * VIEW_W;
+	}
+};
+
+//! One layer-major buffer, each visible row walked directly.
+struct Flat
+{
+	std::vector<Tile> tiles;
+
+	Flat()
+	{
+		tiles.reserve((size_t)MAP_W * MAP_H * MAP_D);
+		for (size_t i = 0; i < (size_t)MAP_W * MAP_H * MAP_D; i++)
+			tiles.push_back(randomTile());
+	}
+
+	size_t frame(int x1, int y1) const
+	{
+		unsigned sum = 0;
+		for (int z = 0; z < MAP_D; z++)
+			for (int y = y1; y < y1 + VIEW_H; y++) {
+				const Tile* row = &tiles[((size_t)z * MAP_H +
+					(size_t)y) * MAP_W + (size_t)x1];
+				for (int i = 0; i < VIEW_W; i++)
+					if (row[i].parent)
+						sum += row[i].flags;
+			}
+		sink = sink + sum;
+		return MAP_D * VIEW_H * VIEW_W;
+	}
+};
+
+//! Now: 16x16 chunks, each visible row walked one chunk-wide run at a
+//! time.
+struct Chunked
+{
+	std::vector<Tile*> chunks;
+	std::vector<std::vector<Tile>> storage;
+
+	Chunked()
+	{
+		size_t cnt = (size_t)(MAP_W / CHUNK) * (MAP_H / CHUNK) * MAP_D;
+		storage.resize(cnt);
+		for (auto& chunk : storage) {
+			chunk.reserve(CHUNK * CHUNK);
+			for (int i = 0; i < CHUNK * CHUNK; i++)
+				chunk.push_back(randomTile());
+			chunks.push_back(chunk.data());
+		}
+	}
+
+	size_t frame(int x1, int y1) const
+	{
+		unsigned sum = 0;
+		for (int z = 0; z < MAP_D; z++)
+			for (int y = y1; y < y1 + VIEW_H; y++)
+				for (int x = x1; x < x1 + VIEW_W; ) {
+					int run = CHUNK - x % CHUNK;
+					if (run > x1 + VIEW_W - x)
+						run = x1 + VIEW_W - x;
+					const Tile* chunk = chunks[
+						((size_t)z * (MAP_H / CHUNK) +
+						 (size_t)(y / CHUNK)) *
+						(MAP_W / CHUNK) +
+						(size_t)(x / CHUNK)];
+					const Tile* row = &chunk[
+						(size_t)(y % CHUNK) * CHUNK +
+						(size_t)(x % CHUNK)];
+					for (int i = 0; i < run; i++)
+						if (row[i].parent)
+							sum += row[i].flags;
+					x += run;
+				}
+		sink = sink + sum;
+		return MAP_D * VIEW_H * VIEW_W;
+	}
+};
+
+template<class Layout>
+static void scan(const char* name, const Layout& layout, const Views& v)
+{
+	size_t i = 0;
+	benchRate(name, "tiles", [&] {
+		size_t tiles = 0;
+		for (int n = 0; n < 1000; n++, i = (i + 1) % v.x.size())
+			tiles += layout.frame(v.x[i], v.y[i]);
+		return tiles;
+	});
+}
+
+int main()
+{
+	srand(1);
+
+	Nested nested;
+	Flat flat;
+	Chunked chunked;
+
+	Views scroll = scrolling(100000);
+	Views jump = jumping(100000);
+
+	printf("visible-cube scan, %dx%d view of a %dx%dx%d map\n",
+	       VIEW_W, VIEW_H, MAP_W, MAP_H, MAP_D);
+	printf("scrolling one Tile per frame:\n");
+	scan("nested vectors", nested, scroll);
+	scan("flat buffer", flat, scroll);
+	scan("16x16 chunks", chunked, scroll);
+	printf("jumping to a new place every frame:\n");
+	scan("nested vectors", nested, jump);
+	scan("flat buffer", flat, jump);
+	scan("16x16 chunks", chunked, jump);
+
+	return 0;
+}
+
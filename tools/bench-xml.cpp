@@ -0,0 +1,174 @@
+/**********************************
+** Tsunagari Tile Engine         **
+** bench-xml.cpp                 **
+** Copyright 2015 PariahSoft LLC **
+**********************************/
+
+// **********
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+// **********
+
+// Reading integer attributes the way TMX loading does, once through the
+// copying path XMLNode::intAttr() used to take (xmlGetProp, a std::string,
+// isInteger() and atoi()) and once through the non-owning view it takes
+// now (attrView() and parseInteger()). Counts heap allocations made by
+// both libxml2 and C++ while reading, and reads per second.
+//
+// XMLNode needs the rest of the engine to open a document, so the two
+// paths are restated here against libxml2 directly. The number parsing is
+// the engine's own.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <new>
+#include <string>
+
+#include <libxml/parser.h>
+#include <libxml/tree.h>
+
+#include "bench.h"
+#include "log.h"
+#include "string.h"
+
+//! A 512x512 layer in the XML tile encoding, one attribute per Tile.
+#define LAYER_TILES (512 * 512)
+
+static size_t allocations;
+
+void* operator new(size_t size)
+{
+	allocations++;
+	if (void* p = malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+static void* countMalloc(size_t size)
+{
+	allocations++;
+	return malloc(size);
+}
+
+static void* countRealloc(void* p, size_t size)
+{
+	allocations++;
+	return realloc(p, size);
+}
+
+static char* countStrdup(const char* s)
+{
+	allocations++;
+	return strdup(s);
+}
+
+// string.cpp reports malformed ranges through Log, which would pull in the
+// rest of the engine. Only well-formed numbers are read here.
+void Log::err(std::string, std::string)
+{
+}
+
+//! Keeps the compiler from optimizing the reads away.
+static volatile int sink;
+
+//! Before: the value is copied twice and scanned twice.
+static bool copyingIntAttr(xmlNode* node, const char* name, int* i)
+{
+	xmlChar* content = xmlGetProp(node, BAD_CAST(name));
+	std::string s = content ? (const char*)content : "";
+	xmlFree(content);
+	if (!isInteger(s))
+		return false;
+	*i = atoi(s.c_str());
+	return true;
+}
+
+//! Now: a pointer into the attribute's text node, parsed in place.
+static bool viewIntAttr(xmlNode* node, const char* name, int* i)
+{
+	xmlAttr* attr = xmlHasProp(node, BAD_CAST(name));
+	const char* value = "";
+	if (attr && attr->children && attr->children->type == XML_TEXT_NODE &&
+	    !attr->children->next)
+		value = (const char*)attr->children->content;
+	return parseInteger(value, i);
+}
+
+template<class Read>
+static size_t readLayer(xmlNode* layer, Read read)
+{
+	size_t reads = 0;
+	int sum = 0;
+	for (xmlNode* node = layer->children; node; node = node->next) {
+		if (node->type != XML_ELEMENT_NODE)
+			continue;
+		int gid;
+		if (read(node, "gid", &gid))
+			sum += gid;
+		reads++;
+	}
+	sink = sink + sum;
+	return reads;
+}
+
+template<class Read>
+static void measure(const char* name, xmlNode* layer, Read read)
+{
+	allocations = 0;
+	size_t reads = readLayer(layer, read);
+	printf("  %-28s %10.2f allocations/read\n", name,
+	       (double)allocations / (double)reads);
+	benchRate(name, "reads", [&] { return readLayer(layer, read); });
+}
+
+int main()
+{
+	xmlMemSetup(free, countMalloc, countRealloc, countStrdup);
+	xmlInitParser();
+
+	std::string xml = "<layer>";
+	for (int i = 0; i < LAYER_TILES; i++)
+		xml += "<tile gid=\"" + std::to_string(i % 300) + "\"/>";
+	xml += "</layer>";
+
+	xmlDoc* doc = xmlReadMemory(xml.data(), (int)xml.size(), "layer.tmx",
+	                            NULL, XML_PARSE_NONET);
+	if (!doc)
+		return 1;
+	xmlNode* layer = xmlDocGetRootElement(doc);
+
+	printf("reading the gid of %d Tiles:\n", LAYER_TILES);
+	measure("xmlGetProp and std::string", layer, copyingIntAttr);
+	measure("attrView and parseInteger", layer, viewIntAttr);
+
+	xmlFreeDoc(doc);
+	xmlCleanupParser();
+	return 0;
+}
+
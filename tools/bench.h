@@ -0,0 +1,58 @@
+/**********************************
+** Tsunagari Tile Engine         **
+** bench.h                       **
+** Copyright 2015 PariahSoft LLC **
+**********************************/
+
+// **********
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+// **********
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+
+#include <chrono>
+
+//! Run fn until at least half a second has passed, then print how many
+//! units of work it did per second. fn returns the units it did.
+template<class Fn>
+static double benchRate(const char* name, const char* unit, Fn fn)
+{
+	typedef std::chrono::steady_clock clock;
+
+	fn(); // Warm up caches and page in memory.
+
+	double units = 0.0;
+	double secs = 0.0;
+	clock::time_point start = clock::now();
+	while (secs < 0.5) {
+		units += (double)fn();
+		secs = std::chrono::duration<double>(clock::now() - start)
+			.count();
+	}
+
+	double rate = units / secs;
+	printf("  %-28s %10.2f M%s/s\n", name, rate / 1e6, unit);
+	return rate;
+}
+
+#endif
+